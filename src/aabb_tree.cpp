@@ -0,0 +1,210 @@
+// internal
+#include "aabb_tree.hpp"
+
+// stlib
+#include <algorithm>
+#include <utility>
+
+int AabbTree::allocate_node()
+{
+	if (free_list == NULL_NODE)
+	{
+		nodes.emplace_back();
+		return (int)nodes.size() - 1;
+	}
+	int index = free_list;
+	free_list = nodes[index].parent;
+	nodes[index] = Node();
+	return index;
+}
+
+void AabbTree::free_node(int index)
+{
+	nodes[index].parent = free_list;
+	nodes[index].height = -1;
+	free_list = index;
+}
+
+int AabbTree::create_proxy(const Aabb& box, unsigned int user)
+{
+	int proxy = allocate_node();
+	nodes[proxy].box = { box.lower - vec2(margin), box.upper + vec2(margin) };
+	nodes[proxy].user = user;
+	insert_leaf(proxy);
+	proxies++;
+	return proxy;
+}
+
+void AabbTree::destroy_proxy(int proxy)
+{
+	assert(nodes[proxy].is_leaf() && nodes[proxy].height == 0);
+	remove_leaf(proxy);
+	free_node(proxy);
+	proxies--;
+}
+
+bool AabbTree::move_proxy(int proxy, const Aabb& box)
+{
+	assert(nodes[proxy].is_leaf() && nodes[proxy].height == 0);
+	if (nodes[proxy].box.contains(box))
+		return false;
+	remove_leaf(proxy);
+	nodes[proxy].box = { box.lower - vec2(margin), box.upper + vec2(margin) };
+	insert_leaf(proxy);
+	return true;
+}
+
+void AabbTree::replace_child(int parent, int old_child, int new_child)
+{
+	if (parent == NULL_NODE)
+		root = new_child;
+	else if (nodes[parent].child1 == old_child)
+		nodes[parent].child1 = new_child;
+	else
+	{
+		assert(nodes[parent].child2 == old_child);
+		nodes[parent].child2 = new_child;
+	}
+}
+
+void AabbTree::insert_leaf(int leaf)
+{
+	if (root == NULL_NODE)
+	{
+		root = leaf;
+		nodes[leaf].parent = NULL_NODE;
+		return;
+	}
+
+	// Descend to the sibling with the least perimeter growth, a node pays the growth of its own box
+	// plus the growth the leaf causes to all its ancestors
+	const Aabb leaf_box = nodes[leaf].box;
+	int index = root;
+	while (!nodes[index].is_leaf())
+	{
+		const Node& node = nodes[index];
+		const float area = node.box.perimeter();
+		const float combined = Aabb::merge(node.box, leaf_box).perimeter();
+		// Cost of pairing the leaf with this node, and the minimum cost pushed down to the children
+		const float cost = 2.f * combined;
+		const float inheritance = 2.f * (combined - area);
+
+		float child_cost[2];
+		const int children[2] = { node.child1, node.child2 };
+		for (int c = 0; c < 2; c++)
+		{
+			const Node& child = nodes[children[c]];
+			const float grown = Aabb::merge(child.box, leaf_box).perimeter();
+			child_cost[c] = (child.is_leaf() ? grown : grown - child.box.perimeter()) + inheritance;
+		}
+
+		if (cost < child_cost[0] && cost < child_cost[1])
+			break;
+		index = child_cost[0] < child_cost[1] ? children[0] : children[1];
+	}
+
+	// A new parent joins the sibling and the leaf
+	const int sibling = index;
+	const int old_parent = nodes[sibling].parent;
+	const int new_parent = allocate_node();
+	nodes[new_parent].parent = old_parent;
+	nodes[new_parent].box = Aabb::merge(nodes[sibling].box, leaf_box);
+	nodes[new_parent].height = nodes[sibling].height + 1;
+	nodes[new_parent].child1 = sibling;
+	nodes[new_parent].child2 = leaf;
+	replace_child(old_parent, sibling, new_parent);
+	nodes[sibling].parent = new_parent;
+	nodes[leaf].parent = new_parent;
+
+	refit_up(new_parent);
+}
+
+void AabbTree::remove_leaf(int leaf)
+{
+	if (leaf == root)
+	{
+		root = NULL_NODE;
+		return;
+	}
+
+	// The sibling takes the place of the parent
+	const int parent = nodes[leaf].parent;
+	const int grand_parent = nodes[parent].parent;
+	const int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+	replace_child(grand_parent, parent, sibling);
+	nodes[sibling].parent = grand_parent;
+	free_node(parent);
+
+	if (grand_parent != NULL_NODE)
+		refit_up(grand_parent);
+}
+
+void AabbTree::refit_up(int index)
+{
+	while (index != NULL_NODE)
+	{
+		index = balance(index);
+		Node& node = nodes[index];
+		node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+		node.box = Aabb::merge(nodes[node.child1].box, nodes[node.child2].box);
+		index = node.parent;
+	}
+}
+
+int AabbTree::balance(int a)
+{
+	if (nodes[a].is_leaf() || nodes[a].height < 2)
+		return a;
+
+	int b = nodes[a].child1;
+	int c = nodes[a].child2;
+	const int difference = nodes[c].height - nodes[b].height;
+	if (difference >= -1 && difference <= 1)
+		return a;
+	// 'up' is the taller child that takes the place of a, 'other' stays a child of a
+	const int up = difference > 0 ? c : b;
+
+	// Of the two children of 'up', the taller stays with it and the shorter moves to a
+	int f = nodes[up].child1;
+	int g = nodes[up].child2;
+	if (nodes[f].height < nodes[g].height)
+		std::swap(f, g);
+
+	nodes[up].parent = nodes[a].parent;
+	replace_child(nodes[a].parent, a, up);
+	nodes[a].parent = up;
+	nodes[up].child1 = a;
+	nodes[up].child2 = f;
+	replace_child(a, up, g);
+	nodes[g].parent = a;
+
+	Node& node_a = nodes[a];
+	node_a.box = Aabb::merge(nodes[node_a.child1].box, nodes[node_a.child2].box);
+	node_a.height = 1 + std::max(nodes[node_a.child1].height, nodes[node_a.child2].height);
+	Node& node_up = nodes[up];
+	node_up.box = Aabb::merge(node_a.box, nodes[f].box);
+	node_up.height = 1 + std::max(node_a.height, nodes[f].height);
+	return up;
+}
+
+bool AabbTree::segment_crosses(vec2 from, vec2 delta, const Aabb& box)
+{
+	float t_min = 0.f;
+	float t_max = 1.f;
+	for (int axis = 0; axis < 2; axis++)
+	{
+		if (delta[axis] == 0.f)
+		{
+			if (from[axis] < box.lower[axis] || from[axis] > box.upper[axis])
+				return false;
+			continue;
+		}
+		float t1 = (box.lower[axis] - from[axis]) / delta[axis];
+		float t2 = (box.upper[axis] - from[axis]) / delta[axis];
+		t_min = std::max(t_min, std::min(t1, t2));
+		t_max = std::min(t_max, std::max(t1, t2));
+		if (t_min > t_max)
+			return false;
+	}
+	return true;
+}
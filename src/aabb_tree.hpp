@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cassert>
+#include <vector>
+
+#include "common.hpp"
+
+// Axis-aligned bounding box
+struct Aabb
+{
+	vec2 lower;
+	vec2 upper;
+
+	float perimeter() const { return 2.f * ((upper.x - lower.x) + (upper.y - lower.y)); }
+	bool contains(const Aabb& other) const
+	{
+		return lower.x <= other.lower.x && lower.y <= other.lower.y && other.upper.x <= upper.x && other.upper.y <= upper.y;
+	}
+	bool overlaps(const Aabb& other) const
+	{
+		return lower.x <= other.upper.x && other.lower.x <= upper.x && lower.y <= other.upper.y && other.lower.y <= upper.y;
+	}
+	static Aabb merge(const Aabb& a, const Aabb& b) { return { min(a.lower, b.lower), max(a.upper, b.upper) }; }
+};
+
+// Dynamic bounding volume hierarchy over "fat" boxes, each leaf box is the box of its proxy enlarged by a margin.
+// Moving a proxy only touches the tree when it leaves its fat box, then the leaf is removed and re-inserted.
+// Leaves are inserted next to the sibling that grows the perimeters the least, and every node on the way back
+// to the root is rebalanced by a rotation, which keeps the height logarithmic in the number of proxies.
+// Proxies are node indices, they stay valid until destroy_proxy().
+class AabbTree
+{
+public:
+	static const int NULL_NODE = -1;
+
+	explicit AabbTree(float margin = 16.f) : margin(margin) {}
+
+	// Add a box, 'user' is returned by the queries, e.g., the index of an entity
+	int create_proxy(const Aabb& box, unsigned int user);
+	void destroy_proxy(int proxy);
+
+	// Update the box of a proxy, returns true if it left its fat box and was re-inserted
+	bool move_proxy(int proxy, const Aabb& box);
+
+	unsigned int& user(int proxy) { assert(nodes[proxy].is_leaf()); return nodes[proxy].user; }
+	unsigned int user(int proxy) const { assert(nodes[proxy].is_leaf()); return nodes[proxy].user; }
+	const Aabb& fat_box(int proxy) const { return nodes[proxy].box; }
+
+	// Height of the tree, 0 for a single leaf
+	int height() const { return root == NULL_NODE ? 0 : nodes[root].height; }
+	size_t proxy_count() const { return proxies; }
+
+	// Call fn(proxy) for every proxy whose fat box overlaps 'box', stops when fn returns false
+	template <typename Callback>
+	void query(const Aabb& box, Callback fn) const
+	{
+		int stack[QUERY_STACK_SIZE];
+		int top = 0;
+		if (root != NULL_NODE)
+			stack[top++] = root;
+		while (top > 0)
+		{
+			const int index = stack[--top];
+			const Node& node = nodes[index];
+			if (!node.box.overlaps(box))
+				continue;
+			if (node.is_leaf())
+			{
+				if (!fn(index))
+					return;
+			}
+			else
+			{
+				assert(top + 2 <= QUERY_STACK_SIZE);
+				stack[top++] = node.child1;
+				stack[top++] = node.child2;
+			}
+		}
+	}
+
+	// Call fn(proxy) for every proxy whose fat box the segment from 'from' to 'to' crosses, stops when fn returns false
+	template <typename Callback>
+	void ray_cast(vec2 from, vec2 to, Callback fn) const
+	{
+		const Aabb segment_box = { min(from, to), max(from, to) };
+		const vec2 delta = to - from;
+		query(segment_box, [&](int proxy) {
+			return !segment_crosses(from, delta, nodes[proxy].box) || fn(proxy);
+		});
+	}
+
+private:
+	// Deep enough for any balanced tree of 2^32 proxies
+	static const int QUERY_STACK_SIZE = 128;
+
+	struct Node
+	{
+		Aabb box;
+		int parent = NULL_NODE; // next free node while the node is unused
+		int child1 = NULL_NODE;
+		int child2 = NULL_NODE;
+		int height = 0; // 0 for leaves, -1 for free nodes
+		unsigned int user = 0;
+
+		bool is_leaf() const { return child1 == NULL_NODE; }
+	};
+
+	std::vector<Node> nodes;
+	int root = NULL_NODE;
+	int free_list = NULL_NODE;
+	size_t proxies = 0;
+	float margin;
+
+	int allocate_node();
+	void free_node(int index);
+	void insert_leaf(int leaf);
+	void remove_leaf(int leaf);
+	void replace_child(int parent, int old_child, int new_child);
+
+	// Refit the boxes and heights from 'index' up to the root, rotating every node on the way
+	void refit_up(int index);
+	// Rotate the taller child of 'index' up if the heights of its children differ by more than one,
+	// returns the node that now roots the subtree
+	int balance(int index);
+
+	// Slab test of the segment from + t * delta, t in [0, 1], against a box
+	static bool segment_crosses(vec2 from, vec2 delta, const Aabb& box);
+};
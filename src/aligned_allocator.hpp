@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+// Allocator for std::vector that aligns the array to 'Alignment' bytes, e.g., for aligned SIMD loads
+template <typename T, size_t Alignment = 32>
+struct AlignedAllocator
+{
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+	AlignedAllocator() {}
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+	T* allocate(size_t n)
+	{
+		void* p = nullptr;
+#ifdef _MSC_VER
+		p = _aligned_malloc(n * sizeof(T), Alignment);
+#else
+		if (posix_memalign(&p, Alignment, n * sizeof(T)) != 0)
+			p = nullptr;
+#endif
+		if (p == nullptr)
+			throw std::bad_alloc();
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, size_t)
+	{
+#ifdef _MSC_VER
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	}
+};
+
+template <typename T, typename U, size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) { return true; }
+template <typename T, typename U, size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) { return false; }
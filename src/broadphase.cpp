@@ -0,0 +1,290 @@
+// internal
+#include "broadphase.hpp"
+#include "tiny_ecs.hpp"
+
+// stlib
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+	uint64_t pack_cell(int cx, int cy)
+	{
+		return (uint64_t)(uint32_t)cx << 32 | (uint32_t)cy;
+	}
+
+	// Cell coordinate of a position, clamped so that the neighbour coordinates cannot overflow
+	int cell_of(float position, float inv_cell_size)
+	{
+		float c = std::floor(position * inv_cell_size);
+		return (int)std::max(-1.e9f, std::min(1.e9f, c));
+	}
+}
+
+const char* broadphase_name(BROADPHASE_ID id)
+{
+	switch (id)
+	{
+	case BROADPHASE_ID::GRID: return "grid";
+	case BROADPHASE_ID::SWEEP_AND_PRUNE: return "sap";
+	case BROADPHASE_ID::AABB_TREE: return "tree";
+	default: return "unknown";
+	}
+}
+
+bool parse_broadphase(const char* name, BROADPHASE_ID& id)
+{
+	for (int i = 0; i < broadphase_count; i++)
+	{
+		if (strcmp(name, broadphase_name((BROADPHASE_ID)i)) == 0)
+		{
+			id = (BROADPHASE_ID)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+void UniformGrid::test_range(unsigned int i, const std::vector<unsigned int>& bodies, unsigned int begin, unsigned int end, const float* x, const float* y, const float* radius, std::vector<CandidatePair>& pairs)
+{
+	for (unsigned int k = begin; k < end; k++)
+	{
+		unsigned int j = bodies[k];
+		float dx = x[j] - x[i];
+		float dy = y[j] - y[i];
+		float r = radius[i] + radius[j];
+		if (dx * dx + dy * dy < r * r)
+			pairs.push_back(std::make_pair(std::min(i, j), std::max(i, j)));
+	}
+}
+
+void UniformGrid::find_pairs(const float* x, const float* y, const float* radius, unsigned int count, std::vector<CandidatePair>& pairs)
+{
+	const float inv_cell_size = 1.f / cell_size;
+
+	cell_keys.resize(count);
+	order.clear();
+	large.clear();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (2.f * radius[i] > cell_size)
+		{
+			large.push_back(i);
+			continue;
+		}
+		cell_keys[i] = pack_cell(cell_of(x[i], inv_cell_size), cell_of(y[i], inv_cell_size));
+		order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b)
+	{
+		return cell_keys[a] < cell_keys[b] || (cell_keys[a] == cell_keys[b] && a < b);
+	});
+
+	const unsigned int grid_count = (unsigned int)order.size();
+	cells.clear();
+	cell_begins.clear();
+	for (unsigned int begin = 0, end; begin < grid_count; begin = end)
+	{
+		for (end = begin + 1; end < grid_count && cell_keys[order[end]] == cell_keys[order[begin]]; end++);
+		cells.push_back(cell_keys[order[begin]]);
+		cell_begins.push_back(begin);
+	}
+	cell_begins.push_back(grid_count);
+
+	// The neighbours (+1, -1), (+1, 0), (+1, +1) and (0, +1), the other four visit this cell instead
+	// The work items are the cells, followed by the large bodies
+	static const int NEIGHBOURS[4][2] = { { 1, -1 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+	const size_t cell_count = cells.size();
+	chunked_pairs.run(cell_count + large.size(), BROADPHASE_GRAIN, pairs, [&](size_t first_item, size_t last_item, std::vector<CandidatePair>& chunk)
+	{
+		for (size_t item = first_item; item < last_item; item++)
+		{
+			if (item >= cell_count)
+			{
+				// A large body is tested against every body in the grid and the large bodies after it
+				const unsigned int l = (unsigned int)(item - cell_count);
+				test_range(large[l], order, 0, grid_count, x, y, radius, chunk);
+				test_range(large[l], large, l + 1, (unsigned int)large.size(), x, y, radius, chunk);
+				continue;
+			}
+			const unsigned int begin = cell_begins[item];
+			const unsigned int end = cell_begins[item + 1];
+			const int cx = (int)(uint32_t)(cells[item] >> 32);
+			const int cy = (int)(uint32_t)cells[item];
+
+			// The non-empty neighbours, looked up once for all bodies of the cell
+			unsigned int neighbour_begin[4], neighbour_end[4];
+			unsigned int neighbour_count = 0;
+			for (const int* offset : NEIGHBOURS)
+			{
+				const uint64_t key = pack_cell(cx + offset[0], cy + offset[1]);
+				auto neighbour = std::lower_bound(cells.begin(), cells.end(), key);
+				if (neighbour == cells.end() || *neighbour != key)
+					continue;
+				const size_t c = neighbour - cells.begin();
+				neighbour_begin[neighbour_count] = cell_begins[c];
+				neighbour_end[neighbour_count] = cell_begins[c + 1];
+				neighbour_count++;
+			}
+
+			for (unsigned int k = begin; k < end; k++)
+			{
+				unsigned int i = order[k];
+				test_range(i, order, k + 1, end, x, y, radius, chunk);
+				for (unsigned int n = 0; n < neighbour_count; n++)
+					test_range(i, order, neighbour_begin[n], neighbour_end[n], x, y, radius, chunk);
+			}
+		}
+	});
+	std::sort(pairs.begin(), pairs.end());
+}
+
+void SweepAndPrune::find_pairs(const unsigned int* keys, const float* x, const float* y, const float* radius, unsigned int count, std::vector<CandidatePair>& pairs)
+{
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const unsigned int index = keys[i] & ENTITY_INDEX_MASK;
+		if (index >= slot_of_index.size())
+			slot_of_index.resize(index + 1, 0);
+		slot_of_index[index] = i;
+	}
+
+	// Keep the order of the previous step for the bodies that still exist, then append the new ones
+	// A removed body either left a stale entry or its index now belongs to a body with another generation
+	sorted.clear();
+	placed.assign(count, 0);
+	for (unsigned int key : sorted_keys)
+	{
+		const unsigned int index = key & ENTITY_INDEX_MASK;
+		if (index >= slot_of_index.size())
+			continue;
+		const unsigned int slot = slot_of_index[index];
+		if (slot < count && keys[slot] == key && !placed[slot])
+		{
+			sorted.push_back(slot);
+			placed[slot] = 1;
+		}
+	}
+	for (unsigned int i = 0; i < count; i++)
+		if (!placed[i])
+			sorted.push_back(i);
+
+	min_x.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+		min_x[i] = x[i] - radius[i];
+
+	// Insertion sort, linear when the bodies barely moved relative to each other
+	for (unsigned int k = 1; k < count; k++)
+	{
+		unsigned int body = sorted[k];
+		unsigned int m = k;
+		for (; m > 0 && min_x[sorted[m - 1]] > min_x[body]; m--)
+			sorted[m] = sorted[m - 1];
+		sorted[m] = body;
+	}
+
+	// Sweep, the bodies after i overlap its interval only until the first one that starts past its right end
+	chunked_pairs.run(count, BROADPHASE_GRAIN, pairs, [&](size_t first, size_t last, std::vector<CandidatePair>& chunk)
+	{
+		for (size_t k = first; k < last; k++)
+		{
+			unsigned int i = sorted[k];
+			const float max_x = x[i] + radius[i];
+			for (size_t m = k + 1; m < count && min_x[sorted[m]] <= max_x; m++)
+			{
+				unsigned int j = sorted[m];
+				float dx = x[j] - x[i];
+				float dy = y[j] - y[i];
+				float r = radius[i] + radius[j];
+				if (dx * dx + dy * dy < r * r)
+					chunk.push_back(std::make_pair(std::min(i, j), std::max(i, j)));
+			}
+		}
+	});
+	std::sort(pairs.begin(), pairs.end());
+
+	sorted_keys.resize(count);
+	for (unsigned int k = 0; k < count; k++)
+		sorted_keys[k] = keys[sorted[k]];
+}
+
+void AabbTreeBroadphase::find_pairs(const unsigned int* keys, const float* x, const float* y, const float* radius, unsigned int count, std::vector<CandidatePair>& pairs)
+{
+	current_step++;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const Aabb box = { vec2(x[i] - radius[i], y[i] - radius[i]), vec2(x[i] + radius[i], y[i] + radius[i]) };
+		const unsigned int index = keys[i] & ENTITY_INDEX_MASK;
+		if (index >= proxies.size())
+			proxies.resize(index + 1);
+		Proxy& proxy = proxies[index];
+		if (proxy.id == -1)
+		{
+			proxy.id = bvh.create_proxy(box, i);
+			proxy_indices.push_back(index);
+		}
+		else if (proxy.key != keys[i])
+		{
+			// The entity was removed and its index re-used since the last step
+			bvh.destroy_proxy(proxy.id);
+			proxy.id = bvh.create_proxy(box, i);
+		}
+		else
+			bvh.move_proxy(proxy.id, box);
+		proxy.key = keys[i];
+		proxy.step = current_step;
+		bvh.user(proxy.id) = i;
+	}
+	unsigned int kept = 0;
+	for (unsigned int index : proxy_indices)
+	{
+		Proxy& proxy = proxies[index];
+		if (proxy.step == current_step)
+			proxy_indices[kept++] = index;
+		else
+		{
+			bvh.destroy_proxy(proxy.id);
+			proxy.id = -1;
+		}
+	}
+	proxy_indices.resize(kept);
+
+	// Every body queries the fat boxes around its own box, the pair is reported by the lower index
+	const AabbTree& tree = bvh;
+	chunked_pairs.run(count, BROADPHASE_GRAIN, pairs, [&](size_t first, size_t last, std::vector<CandidatePair>& chunk)
+	{
+		for (unsigned int i = (unsigned int)first; i < last; i++)
+		{
+			const Aabb box = { vec2(x[i] - radius[i], y[i] - radius[i]), vec2(x[i] + radius[i], y[i] + radius[i]) };
+			tree.query(box, [&](int proxy) {
+				unsigned int j = tree.user(proxy);
+				if (j > i)
+				{
+					float dx = x[j] - x[i];
+					float dy = y[j] - y[i];
+					float r = radius[i] + radius[j];
+					if (dx * dx + dy * dy < r * r)
+						chunk.push_back(std::make_pair(i, j));
+				}
+				return true;
+			});
+		}
+	});
+	std::sort(pairs.begin(), pairs.end());
+}
+
+void Broadphase::find_pairs(const unsigned int* keys, const float* x, const float* y, const float* radius, unsigned int count, std::vector<CandidatePair>& pairs)
+{
+	switch (selected)
+	{
+	case BROADPHASE_ID::SWEEP_AND_PRUNE:
+		sweep_and_prune.find_pairs(keys, x, y, radius, count, pairs);
+		break;
+	case BROADPHASE_ID::AABB_TREE:
+		aabb_tree.find_pairs(keys, x, y, radius, count, pairs);
+		break;
+	default:
+		grid.find_pairs(x, y, radius, count, pairs);
+		break;
+	}
+}
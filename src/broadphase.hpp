@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "common.hpp"
+#include "aabb_tree.hpp"
+#include "thread_pool.hpp"
+
+// The broadphase algorithms, selectable at runtime through Broadphase::select()
+enum class BROADPHASE_ID {
+	GRID = 0,
+	SWEEP_AND_PRUNE = GRID + 1,
+	AABB_TREE = SWEEP_AND_PRUNE + 1,
+	BROADPHASE_COUNT = AABB_TREE + 1
+};
+const int broadphase_count = (int)BROADPHASE_ID::BROADPHASE_COUNT;
+
+// Short name of a broadphase ("grid", "sap", "tree"), and the reverse, returns false for an unknown name
+const char* broadphase_name(BROADPHASE_ID id);
+bool parse_broadphase(const char* name, BROADPHASE_ID& id);
+
+// Two bodies whose bounding circles overlap, as indices into the broadphase input with first < second
+typedef std::pair<unsigned int, unsigned int> CandidatePair;
+
+// Number of cells (grid) or bodies (sweep and prune, tree) per chunk of a parallel pair search
+const size_t BROADPHASE_GRAIN = 256;
+
+// The pair lists of a parallel pair search, one per chunk of the work. The chunks run on the worker threads
+// and their lists are concatenated in chunk order, so the result does not depend on the thread timing.
+class ChunkedPairs
+{
+	std::vector<std::vector<CandidatePair>> chunks;
+public:
+	// Call fn(begin, end, chunk_pairs) for consecutive chunks of at most 'grain' of the 'count' work items,
+	// then replace 'pairs' by the concatenation of all chunk lists
+	template <typename Function>
+	void run(size_t count, size_t grain, std::vector<CandidatePair>& pairs, Function fn)
+	{
+		const size_t chunk_count = (count + grain - 1) / grain;
+		if (chunks.size() < chunk_count)
+			chunks.resize(chunk_count);
+		ThreadPool::shared().parallel_for(chunk_count, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t c = begin; c < end; c++)
+			{
+				chunks[c].clear();
+				fn(c * grain, std::min((c + 1) * grain, count), chunks[c]);
+			}
+		});
+		pairs.clear();
+		for (size_t c = 0; c < chunk_count; c++)
+			pairs.insert(pairs.end(), chunks[c].begin(), chunks[c].end());
+	}
+};
+
+// Uniform grid broadphase with a fixed cell size, sorts the bodies by the cell of their center.
+// Bodies whose bounding circle fits into a cell are in the grid, two of them that overlap are always in the
+// same or in neighbouring cells. Only half of the 8 neighbours are visited from each cell, which reports every
+// unordered pair once. Larger bodies, e.g., long debug lines, are kept in a separate list and tested against
+// all others, so a few of them do not coarsen the grid for everybody. The cells and the large bodies are
+// searched in parallel. All arrays keep their capacity between steps.
+class UniformGrid
+{
+	float cell_size;
+
+	// Per body, the packed (x, y) cell coordinates
+	std::vector<uint64_t> cell_keys;
+	// Indices of the bodies in the grid, sorted by cell, bodies of a cell are consecutive
+	std::vector<unsigned int> order;
+	// Indices of the bodies too large for a cell
+	std::vector<unsigned int> large;
+	// The packed coordinates of every non-empty cell in ascending order, neighbours are found by binary search
+	std::vector<uint64_t> cells;
+	// Offset in 'order' of the first body of every non-empty cell, plus one past the last body at the end
+	// The cells are the work items of the search.
+	std::vector<unsigned int> cell_begins;
+	ChunkedPairs chunked_pairs;
+
+	// Report the overlapping pairs of body i with the bodies bodies[begin, end)
+	static void test_range(unsigned int i, const std::vector<unsigned int>& bodies, unsigned int begin, unsigned int end, const float* x, const float* y, const float* radius, std::vector<CandidatePair>& pairs);
+public:
+	// The default fits the bounding circles of the salmon, fish and turtles
+	explicit UniformGrid(float cell_size = 192.f) : cell_size(cell_size) {}
+
+	// Replace 'pairs' by all pairs of the 'count' circles (x[i], y[i], radius[i]) that overlap
+	// The pairs are sorted by their first index, then by their second.
+	void find_pairs(const float* x, const float* y, const float* radius, unsigned int count, std::vector<CandidatePair>& pairs);
+};
+
+// Sort-and-sweep broadphase on the x-axis, with temporal coherence.
+// The bodies stay sorted by the left end of their interval from one step to the next, identified by their key,
+// so the insertion sort only moves the few bodies that overtook a neighbour. New bodies are appended and
+// sorted in, removed bodies are dropped. Suits our entities, which mostly move horizontally at similar speeds.
+class SweepAndPrune
+{
+	// Keys of the bodies in sorted order at the end of the previous step
+	std::vector<unsigned int> sorted_keys;
+
+	// The slot of every key in the current step, indexed by the entity index of the key
+	// Entries are never reset, an entry is only valid if the key in its slot has the same generation.
+	std::vector<unsigned int> slot_of_index;
+
+	// Scratch arrays, re-used every step
+	std::vector<unsigned int> sorted;
+	std::vector<uint8_t> placed;
+	std::vector<float> min_x;
+	ChunkedPairs chunked_pairs;
+public:
+	// As UniformGrid::find_pairs(), 'keys' are the entity ids of the bodies, they identify the bodies across steps
+	void find_pairs(const unsigned int* keys, const float* x, const float* y, const float* radius, unsigned int count, std::vector<CandidatePair>& pairs);
+};
+
+// Broadphase over a dynamic AABB tree, suits a mix of very different sizes where a grid cell cannot fit all.
+// Every body keeps a proxy in the tree across steps, identified by its key, and only bodies that left their
+// fat box are re-inserted. The same tree serves region and ray queries through tree().
+class AabbTreeBroadphase
+{
+	AabbTree bvh;
+
+	// The proxy of every key and the step it was last seen in, the proxies of keys not seen in a step are destroyed
+	struct Proxy
+	{
+		int id = -1; // -1 for no proxy
+		unsigned int key = 0;
+		unsigned int step = 0;
+	};
+	// Indexed by the entity index of the key, a proxy whose key has another generation belongs to a removed entity
+	std::vector<Proxy> proxies;
+	// Entity indices of all entries with a proxy, the only ones checked for removal
+	std::vector<unsigned int> proxy_indices;
+	unsigned int current_step = 0;
+	ChunkedPairs chunked_pairs;
+public:
+	// As SweepAndPrune::find_pairs(), the user value of every proxy is the index of its body in this call
+	void find_pairs(const unsigned int* keys, const float* x, const float* y, const float* radius, unsigned int count, std::vector<CandidatePair>& pairs);
+
+	const AabbTree& tree() const { return bvh; }
+};
+
+// The selected broadphase, the others keep their state so that switching back and forth is cheap
+class Broadphase
+{
+	BROADPHASE_ID selected = BROADPHASE_ID::GRID;
+	UniformGrid grid;
+	SweepAndPrune sweep_and_prune;
+	AabbTreeBroadphase aabb_tree;
+public:
+	void select(BROADPHASE_ID id) { selected = id; }
+	BROADPHASE_ID selected_id() const { return selected; }
+
+	// The tree of the last step run with BROADPHASE_ID::AABB_TREE, for region and ray queries
+	const AabbTree& tree() const { return aabb_tree.tree(); }
+
+	// Replace 'pairs' by all pairs of overlapping circles, sorted, see UniformGrid::find_pairs()
+	void find_pairs(const unsigned int* keys, const float* x, const float* y, const float* radius, unsigned int count, std::vector<CandidatePair>& pairs);
+};
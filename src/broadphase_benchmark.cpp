@@ -0,0 +1,108 @@
+// internal
+#include "broadphase_benchmark.hpp"
+#include "broadphase.hpp"
+#include "narrowphase.hpp"
+
+// stlib
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+using BenchmarkClock = std::chrono::high_resolution_clock;
+
+namespace {
+	const float LEVEL_WIDTH = 1920.f;
+	const float LEVEL_HEIGHT = 1080.f;
+
+	struct Bodies
+	{
+		std::vector<unsigned int> keys;
+		std::vector<float> x, y, vx, vy, radius;
+
+		// Advance all bodies, the ones that left the level re-enter at the right edge
+		void move(float step_seconds)
+		{
+			for (size_t i = 0; i < keys.size(); i++)
+			{
+				x[i] += vx[i] * step_seconds;
+				y[i] += vy[i] * step_seconds;
+				if (y[i] < 0.f || y[i] > LEVEL_HEIGHT)
+					vy[i] = -vy[i];
+				if (x[i] < -radius[i])
+					x[i] += LEVEL_WIDTH + 2.f * radius[i];
+			}
+		}
+	};
+
+	Bodies make_bodies(unsigned int entity_count)
+	{
+		std::default_random_engine rng;
+		std::uniform_real_distribution<float> uniform_dist;
+		Bodies bodies;
+		for (unsigned int i = 0; i < entity_count; i++)
+		{
+			bodies.keys.push_back(i);
+			bodies.x.push_back(uniform_dist(rng) * LEVEL_WIDTH);
+			bodies.y.push_back(50.f + uniform_dist(rng) * (LEVEL_HEIGHT - 100.f));
+			bodies.vx.push_back(-200.f);
+			bodies.vy.push_back(uniform_dist(rng) < 0.5f ? -200.f : 200.f);
+			bodies.radius.push_back(62.5f);
+		}
+		return bodies;
+	}
+
+	void run_broadphase(BROADPHASE_ID id, unsigned int entity_count, unsigned int iterations)
+	{
+		Bodies bodies = make_bodies(entity_count);
+		Broadphase broadphase;
+		broadphase.select(id);
+		std::vector<CandidatePair> pairs;
+
+		size_t pair_count = 0;
+		auto start = BenchmarkClock::now();
+		for (unsigned int it = 0; it < iterations; it++)
+		{
+			bodies.move(1.f / 60.f);
+			broadphase.find_pairs(bodies.keys.data(), bodies.x.data(), bodies.y.data(), bodies.radius.data(), entity_count, pairs);
+			pair_count += pairs.size();
+		}
+		float total_ms = (float)std::chrono::duration_cast<std::chrono::microseconds>(BenchmarkClock::now() - start).count() / 1000;
+
+		printf("%-6s %u steps %8.3f ms, %8.3f ms per step, %zu pairs per step\n",
+			broadphase_name(id), iterations, total_ms, total_ms / iterations, pair_count / iterations);
+	}
+
+	// Circle tests of the candidate pairs of one step, repeated to get a measurable time
+	void run_narrowphase(unsigned int entity_count, unsigned int iterations)
+	{
+		Bodies bodies = make_bodies(entity_count);
+		Broadphase broadphase;
+		std::vector<CandidatePair> pairs;
+		broadphase.find_pairs(bodies.keys.data(), bodies.x.data(), bodies.y.data(), bodies.radius.data(), entity_count, pairs);
+
+		BatchNarrowphase narrowphase;
+		for (unsigned int k = 0; k < pairs.size(); k++)
+		{
+			unsigned int i = pairs[k].first;
+			unsigned int j = pairs[k].second;
+			narrowphase.add_distance_test(k, { bodies.x[j] - bodies.x[i], bodies.y[j] - bodies.y[i] }, 50.f * 50.f);
+		}
+
+		std::vector<unsigned int> hits;
+		auto start = BenchmarkClock::now();
+		for (unsigned int it = 0; it < iterations; it++)
+			narrowphase.run(hits);
+		float total_ms = (float)std::chrono::duration_cast<std::chrono::microseconds>(BenchmarkClock::now() - start).count() / 1000;
+
+		printf("narrowphase %u x %zu tests %8.3f ms, %8.0f tests per ms, %zu hits\n",
+			iterations, narrowphase.size(), total_ms, (float)iterations * narrowphase.size() / max(total_ms, 0.001f), hits.size());
+	}
+}
+
+void run_broadphase_benchmark(unsigned int entity_count, unsigned int iterations)
+{
+	printf("Broadphase benchmark with %u salmon-like entities\n", entity_count);
+	for (int i = 0; i < broadphase_count; i++)
+		run_broadphase((BROADPHASE_ID)i, entity_count, iterations);
+	run_narrowphase(entity_count, iterations);
+}
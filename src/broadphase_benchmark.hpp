@@ -0,0 +1,7 @@
+#pragma once
+
+// Compares the broadphase algorithms on salmon-like entities that spawn at the right edge and swim left
+// at -200 px/s while bouncing vertically, as spawned by WorldSystem::step. Also times the batched narrowphase
+// on the candidate pairs.
+// Run with: salmon --benchmark-broadphase [entity_count]
+void run_broadphase_benchmark(unsigned int entity_count, unsigned int iterations);
@@ -0,0 +1,20 @@
+// internal
+#include "command_buffer.hpp"
+
+CommandBuffer commands;
+
+void CommandBuffer::playback()
+{
+	while (!records.empty())
+	{
+		playing.swap(records);
+		playing_payloads.swap(payloads);
+		for (const Record& record : playing)
+			if (Entity::is_alive(record.entity))
+				record.apply(record.entity, playing_payloads.data() + record.offset);
+		playing.clear();
+		playing_payloads.clear();
+	}
+	// The created entities now belong to the world
+	created.clear();
+}
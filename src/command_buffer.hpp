@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstring>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#include "tiny_ecs_registry.hpp"
+
+// Records structural changes (create, destroy, add and remove components) while systems iterate
+// the dense container arrays, and applies them in one batch at a sync point with playback().
+// The main loop plays the buffer back after the collisions are handled and before drawing.
+// Every command is a typed record of the function that applies it, the entity and the offset of its
+// arguments in a byte buffer. Both vectors keep their capacity, recording does not allocate in steady state.
+class CommandBuffer
+{
+	struct Record
+	{
+		void (*apply)(Entity e, const unsigned char* payload);
+		Entity entity;
+		size_t offset; // of the payload in the byte buffer
+	};
+
+	std::vector<Record> records;
+	std::vector<unsigned char> payloads;
+	// Handles handed out by create() since the last playback, clear() releases them again
+	std::vector<Entity> created;
+	// The batch being applied, kept to re-use its capacity
+	std::vector<Record> playing;
+	std::vector<unsigned char> playing_payloads;
+
+	// A function and its argument, see call()
+	template <typename Payload>
+	struct Call
+	{
+		void (*fn)(const Payload&);
+		Payload payload;
+	};
+
+	// Append the bytes of the payload, aligned for reading it in place
+	// The buffer of a std::vector is allocated with operator new and thus aligned for any fundamental type
+	template <typename Payload>
+	size_t push_payload(const Payload& payload)
+	{
+		static_assert(std::is_trivially_copyable<Payload>::value, "Command arguments are stored as raw bytes");
+		static_assert(alignof(Payload) <= alignof(std::max_align_t), "Command arguments must not be over-aligned");
+		size_t offset = (payloads.size() + alignof(Payload) - 1) / alignof(Payload) * alignof(Payload);
+		payloads.resize(offset + sizeof(Payload));
+		memcpy(payloads.data() + offset, &payload, sizeof(Payload));
+		return offset;
+	}
+
+	template <typename Payload>
+	static const Payload& payload_at(const unsigned char* payload) { return *reinterpret_cast<const Payload*>(payload); }
+
+	static void apply_destroy(Entity e, const unsigned char*) { registry.remove_all_components_of(e); }
+
+	template <typename Component>
+	static void apply_insert(Entity e, const unsigned char* payload) { registry.container<Component>().insert(e, payload_at<Component>(payload)); }
+
+	template <typename Component>
+	static void apply_remove(Entity e, const unsigned char*) { registry.container<Component>().remove(e); }
+
+	template <typename Payload>
+	static void apply_call(Entity, const unsigned char* payload)
+	{
+		const Call<Payload>& call = payload_at<Call<Payload>>(payload);
+		call.fn(call.payload);
+	}
+
+	void push(void (*apply)(Entity, const unsigned char*), Entity e, size_t offset = 0)
+	{
+		records.push_back({ apply, e, offset });
+	}
+
+public:
+	// The handle is reserved right away so that further commands can refer to it, components are added on playback
+	Entity create()
+	{
+		Entity e;
+		created.push_back(e);
+		return e;
+	}
+
+	// Remove all components of the entity and release its handle
+	void destroy(Entity e)
+	{
+		push(&apply_destroy, e);
+	}
+
+	// The component is copied into the buffer, so it has to be trivially copyable
+	template <typename Component>
+	void insert(Entity e, const Component& c)
+	{
+		push(&apply_insert<Component>, e, push_payload(c));
+	}
+
+	template <typename Component, typename... Args>
+	void emplace(Entity e, Args &&... args)
+	{
+		insert(e, Component(std::forward<Args>(args)...));
+	}
+
+	template <typename Component>
+	void remove(Entity e)
+	{
+		push(&apply_remove<Component>, e);
+	}
+
+	// Any other structural change, e.g., fn wraps one of the create functions of world_init
+	// The argument is copied into the buffer, so it has to be trivially copyable
+	// Recorded with the handle of index 0, which is never released, so the call is always applied
+	template <typename Payload>
+	void call(void (*fn)(const Payload&), const Payload& payload)
+	{
+		push(&apply_call<Payload>, Entity::from_index(0), push_payload(Call<Payload>{ fn, payload }));
+	}
+
+	// Apply all recorded commands in the order they were recorded
+	// Commands recorded during playback are applied in the same batch. Commands whose entity is no longer alive,
+	// e.g., it was destroyed by an earlier command, are skipped.
+	void playback();
+
+	// Drop all recorded commands without applying them, e.g., when the world they refer to was replaced
+	// The handles of create() are released, unless they were already made stale, e.g., by Registry::restore()
+	void clear()
+	{
+		for (Entity e : created)
+			registry.remove_all_components_of(e);
+		created.clear();
+		records.clear();
+		payloads.clear();
+	}
+
+	bool empty() const { return records.empty(); }
+};
+
+extern CommandBuffer commands;
@@ -30,12 +30,12 @@ struct Motion {
 	vec2 scale = { 10, 10 };
 };
 
-// Stucture to store collision information
-struct Collision
-{
-	// Note, the first object is stored in the ECS container.entities
-	Entity other; // the second object involved in the collision
-	Collision(Entity& other) { this->other = other; };
+// The Motion at the start of the last simulation step, the renderer interpolates from it to the current Motion
+// Not a component, the registry keeps one per entity index, see ECSRegistry::previous_motion()
+struct PreviousMotion {
+	unsigned int entity = 0; // id of the entity it was saved for, 0 is never handed out
+	vec2 position = { 0, 0 };
+	float angle = 0;
 };
 
 // Data structure for toggling debug mode
@@ -143,3 +143,5 @@ struct RenderRequest {
 	GEOMETRY_BUFFER_ID used_geometry = GEOMETRY_BUFFER_ID::GEOMETRY_COUNT;
 };
 
+// Motion components are stored as one array per field, see MotionArray
+#include "motion_storage.hpp"
@@ -0,0 +1,56 @@
+// internal
+#include "contact_buffer.hpp"
+
+// stlib
+#include <algorithm>
+
+void ContactBuffer::add(Entity a, Entity b, vec2 normal_ab, float depth_ab)
+{
+	if ((unsigned int)b < (unsigned int)a)
+	{
+		std::swap(a, b);
+		normal_ab = -normal_ab;
+	}
+	keys.push_back((uint64_t)(unsigned int)a << 32 | (unsigned int)b);
+	entity_a.push_back(a);
+	entity_b.push_back(b);
+	normal.push_back(normal_ab);
+	depth.push_back(depth_ab);
+}
+
+void ContactBuffer::append(const ContactBuffer& other)
+{
+	keys.insert(keys.end(), other.keys.begin(), other.keys.end());
+	entity_a.insert(entity_a.end(), other.entity_a.begin(), other.entity_a.end());
+	entity_b.insert(entity_b.end(), other.entity_b.begin(), other.entity_b.end());
+	normal.insert(normal.end(), other.normal.begin(), other.normal.end());
+	depth.insert(depth.end(), other.depth.begin(), other.depth.end());
+}
+
+void ContactBuffer::finish()
+{
+	order.resize(keys.size());
+	for (unsigned int i = 0; i < order.size(); i++)
+		order[i] = i;
+	// Ties are broken by the order of reporting, so the result does not depend on the sort implementation
+	std::sort(order.begin(), order.end(), [&](unsigned int i, unsigned int j)
+	{
+		return keys[i] < keys[j] || (keys[i] == keys[j] && i < j);
+	});
+	order.erase(std::unique(order.begin(), order.end(), [&](unsigned int i, unsigned int j) { return keys[i] == keys[j]; }), order.end());
+
+	gather(keys, scratch_keys);
+	gather(entity_a, scratch_entities);
+	gather(entity_b, scratch_entities);
+	gather(normal, scratch_normals);
+	gather(depth, scratch_depths);
+}
+
+void ContactBuffer::clear()
+{
+	keys.clear();
+	entity_a.clear();
+	entity_b.clear();
+	normal.clear();
+	depth.clear();
+}
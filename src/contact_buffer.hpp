@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "common.hpp"
+#include "tiny_ecs.hpp"
+
+// The contacts found by the physics system in one step, consumed by WorldSystem::handle_collisions
+// Stored as a structure of arrays, contact i is (entity_a[i], entity_b[i], normal[i], depth[i]).
+// Every unordered pair is stored once, oriented so that entity_a has the lower id. All arrays keep their
+// capacity when cleared, so a frame with no more contacts than a previous one does not allocate.
+class ContactBuffer
+{
+	// Key of the unordered pair, the id of entity_a in the upper bits, for sorting and deduplication
+	std::vector<uint64_t> keys;
+
+	// Scratch arrays for finish(), swapped with the contact arrays to re-use both capacities
+	std::vector<unsigned int> order;
+	std::vector<uint64_t> scratch_keys;
+	std::vector<Entity> scratch_entities;
+	std::vector<vec2> scratch_normals;
+	std::vector<float> scratch_depths;
+
+	// Keep only the contacts listed in 'order', in that order
+	template <typename T>
+	void gather(std::vector<T>& values, std::vector<T>& scratch)
+	{
+		scratch.clear();
+		for (unsigned int i : order)
+			scratch.push_back(values[i]);
+		values.swap(scratch);
+	}
+public:
+	std::vector<Entity> entity_a;
+	std::vector<Entity> entity_b;
+	std::vector<vec2> normal; // unit vector pointing from entity_a to entity_b
+	std::vector<float> depth; // penetration along the normal
+
+	// Record a contact, the normal points from a to b
+	void add(Entity a, Entity b, vec2 normal_ab, float depth_ab);
+
+	// Add all contacts of another buffer after the ones recorded so far, e.g., of a worker thread
+	void append(const ContactBuffer& other);
+
+	// Sort the contacts by entity pair and drop repeated pairs, the first reported contact of a pair is kept
+	void finish();
+
+	// Forget all contacts of the previous step
+	void clear();
+
+	size_t size() const { return entity_a.size(); }
+	bool empty() const { return entity_a.empty(); }
+};
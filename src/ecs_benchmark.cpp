@@ -0,0 +1,117 @@
+// internal
+#include "ecs_benchmark.hpp"
+#include "components.hpp"
+#include "tiny_ecs.hpp"
+#include "tiny_ecs_archetype.hpp"
+
+// stlib
+#include <chrono>
+#include <cstdio>
+
+using BenchmarkClock = std::chrono::high_resolution_clock;
+
+namespace {
+	// The current storage, one ComponentContainer per component type
+	struct PerTypeBackend
+	{
+		static const char* name() { return "per-type containers"; }
+
+		ComponentContainer<Motion> motions;
+		ComponentContainer<RenderRequest> renderRequests;
+		ComponentContainer<Mesh*> meshPtrs;
+		TagContainer<SoftShell> softShells;
+
+		void spawn(Entity e, const Motion& motion, const RenderRequest& request)
+		{
+			meshPtrs.insert(e, nullptr);
+			motions.insert(e, motion);
+			softShells.emplace(e);
+			renderRequests.insert(e, request);
+		}
+
+		template <typename Function>
+		void each_moving(Function fn)
+		{
+			View<Motion, SoftShell>(motions, softShells).each([&](Entity, MotionRef motion, SoftShell&) { fn(motion); });
+		}
+
+		void destroy(Entity e)
+		{
+			meshPtrs.remove(e);
+			motions.remove(e);
+			softShells.remove(e);
+			renderRequests.remove(e);
+		}
+	};
+
+	// The chunked storage, entities grouped by their component signature
+	struct ArchetypeBackend
+	{
+		static const char* name() { return "archetype chunks"; }
+
+		ArchetypeStorage storage;
+
+		void spawn(Entity e, const Motion& motion, const RenderRequest& request)
+		{
+			storage.insert(e, (Mesh*)nullptr, motion, SoftShell(), request);
+		}
+
+		template <typename Function>
+		void each_moving(Function fn)
+		{
+			storage.each<Motion, SoftShell>([&](Entity, Motion& motion, SoftShell&) { fn(motion); });
+		}
+
+		void destroy(Entity e)
+		{
+			storage.remove_all_components_of(e);
+		}
+	};
+
+	float elapsed_ms(BenchmarkClock::time_point start)
+	{
+		return (float)std::chrono::duration_cast<std::chrono::microseconds>(BenchmarkClock::now() - start).count() / 1000;
+	}
+
+	// The storage backend is chosen at compile time through the template argument
+	template <typename Backend>
+	void run_workload(unsigned int entity_count, unsigned int iterations)
+	{
+		Backend backend;
+		std::vector<Entity> entities(entity_count);
+
+		auto start = BenchmarkClock::now();
+		for (unsigned int i = 0; i < entity_count; i++)
+		{
+			Motion motion;
+			motion.position = { 1200.f + (float)(i % 100), (float)(i % 800) };
+			motion.velocity = { -200.f, (i % 2) ? 200.f : -200.f };
+			backend.spawn(entities[i], motion, { TEXTURE_ASSET_ID::TEXTURE_COUNT, EFFECT_ASSET_ID::SALMON, GEOMETRY_BUFFER_ID::SALMON });
+		}
+		float spawn_ms = elapsed_ms(start);
+
+		start = BenchmarkClock::now();
+		const float step_seconds = 1.f / 60.f;
+		for (unsigned int it = 0; it < iterations; it++)
+			backend.each_moving([&](auto&& motion) { motion.position += motion.velocity * step_seconds; });
+		float iterate_ms = elapsed_ms(start);
+
+		start = BenchmarkClock::now();
+		for (Entity e : entities)
+			backend.destroy(e);
+		float destroy_ms = elapsed_ms(start);
+
+		for (Entity e : entities)
+			Entity::release(e);
+
+		printf("%-20s spawn %8.3f ms, %u x integrate %8.3f ms, destroy %8.3f ms\n",
+			Backend::name(), spawn_ms, iterations, iterate_ms, destroy_ms);
+	}
+}
+
+void run_ecs_storage_benchmark(unsigned int entity_count, unsigned int iterations)
+{
+	printf("ECS storage benchmark with %u salmon-like entities\n", entity_count);
+	run_workload<PerTypeBackend>(entity_count, iterations);
+	run_workload<ArchetypeBackend>(entity_count, iterations);
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Compares the per-type ComponentContainer storage against the chunked ArchetypeStorage
+// on a salmon-like workload (spawn, integrate Motion of all SoftShell entities, destroy).
+// Run with: salmon --benchmark-ecs [entity_count]
+void run_ecs_storage_benchmark(unsigned int entity_count, unsigned int iterations);
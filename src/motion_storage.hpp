@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cassert>
+#include <memory>
+#include <vector>
+
+#include "common.hpp"
+#include "tiny_ecs.hpp"
+#include "components.hpp"
+
+// A Motion in a MotionArray, every member refers to the field in its own array
+// Reads and writes go straight to the arrays, converting to a Motion copies the fields out.
+struct MotionRef
+{
+	vec2& position;
+	float& angle;
+	vec2& velocity;
+	vec2& scale;
+
+	operator Motion() const
+	{
+		Motion motion;
+		motion.position = position;
+		motion.angle = angle;
+		motion.velocity = velocity;
+		motion.scale = scale;
+		return motion;
+	}
+
+	// Assignments copy the fields, a MotionRef always refers to the same slot
+	MotionRef& operator=(const Motion& motion)
+	{
+		position = motion.position;
+		angle = motion.angle;
+		velocity = motion.velocity;
+		scale = motion.scale;
+		return *this;
+	}
+	MotionRef& operator=(const MotionRef& other)
+	{
+		return *this = (Motion)other;
+	}
+};
+
+// Exchange the fields of two slots, e.g., when the owning group moves a member
+inline void swap(MotionRef a, MotionRef b)
+{
+	Motion temp = a;
+	a = b;
+	b = temp;
+}
+
+// The Motion components as a structure of arrays, one array per field in the dense order of the container.
+// The x and y of a field stay next to each other, so that position += velocity * step is one multiply-add over
+// 2 * size() floats, see PhysicsSystem, and MotionRef can hand out plain vec2 references.
+// Only the part of the std::vector interface that ComponentContainer uses, elements are MotionRef proxies.
+template <typename Allocator>
+class MotionArray
+{
+	template <typename T>
+	using ArrayOf = std::vector<T, typename std::allocator_traits<Allocator>::template rebind_alloc<T>>;
+public:
+	ArrayOf<vec2> position;
+	ArrayOf<float> angle;
+	ArrayOf<vec2> velocity;
+	ArrayOf<vec2> scale;
+
+	// A slot index, the array only grows and shrinks at the end
+	typedef size_t iterator;
+
+	MotionArray() {}
+	explicit MotionArray(const Allocator& allocator)
+		: position(allocator), angle(allocator), velocity(allocator), scale(allocator) {}
+
+	size_t size() const { return position.size(); }
+	bool empty() const { return position.empty(); }
+	size_t capacity() const { return position.capacity(); }
+	iterator begin() const { return 0; }
+	iterator end() const { return size(); }
+
+	MotionRef operator[](size_t i) { return { position[i], angle[i], velocity[i], scale[i] }; }
+	Motion operator[](size_t i) const
+	{
+		Motion motion;
+		motion.position = position[i];
+		motion.angle = angle[i];
+		motion.velocity = velocity[i];
+		motion.scale = scale[i];
+		return motion;
+	}
+	MotionRef back() { return (*this)[size() - 1]; }
+
+	void reserve(size_t count)
+	{
+		position.reserve(count);
+		angle.reserve(count);
+		velocity.reserve(count);
+		scale.reserve(count);
+	}
+
+	void clear()
+	{
+		position.clear();
+		angle.clear();
+		velocity.clear();
+		scale.clear();
+	}
+
+	void push_back(const Motion& motion)
+	{
+		position.push_back(motion.position);
+		angle.push_back(motion.angle);
+		velocity.push_back(motion.velocity);
+		scale.push_back(motion.scale);
+	}
+
+	void pop_back()
+	{
+		position.pop_back();
+		angle.pop_back();
+		velocity.pop_back();
+		scale.pop_back();
+	}
+
+	// Append 'count' copies of a motion, only at the end
+	void insert(iterator where, size_t count, const Motion& motion)
+	{
+		assert(where == size() && "MotionArray only inserts at the end");
+		position.insert(position.end(), count, motion.position);
+		angle.insert(angle.end(), count, motion.angle);
+		velocity.insert(velocity.end(), count, motion.velocity);
+		scale.insert(scale.end(), count, motion.scale);
+	}
+
+	// Remove the slots [first, last), only at the end
+	void erase(iterator first, iterator last)
+	{
+		assert(last == size() && "MotionArray only erases at the end");
+		position.erase(position.begin() + first, position.end());
+		angle.erase(angle.begin() + first, angle.end());
+		velocity.erase(velocity.begin() + first, velocity.end());
+		scale.erase(scale.begin() + first, scale.end());
+	}
+};
+
+// Motion components are stored field by field
+template <typename Allocator>
+struct ComponentStorage<Motion, Allocator>
+{
+	typedef MotionArray<Allocator> Array;
+	typedef MotionRef Reference;
+	typedef Motion ConstReference;
+	static const bool contiguous = false;
+};
@@ -0,0 +1,105 @@
+// internal
+#include "narrowphase.hpp"
+
+// stlib
+#include <algorithm>
+#include <cmath>
+
+// SIMD intrinsics, AVX2 is only used when the compiler targets it (see SALMON_AVX2 in CMakeLists.txt)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NARROWPHASE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+	// Append the ids of the lanes set in 'mask'
+	inline void append_hits(unsigned int mask, const unsigned int* ids, std::vector<unsigned int>& hits)
+	{
+		for (; mask != 0; mask &= mask - 1)
+			hits.push_back(ids[lowest_bit_index(mask)]);
+	}
+
+	void run_distance_tests(const unsigned int* ids, const float* dx, const float* dy, const float* limit_sq, size_t n, std::vector<unsigned int>& hits)
+	{
+		size_t i = 0;
+#if defined(__AVX2__)
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 x = _mm256_load_ps(dx + i);
+			__m256 y = _mm256_load_ps(dy + i);
+			__m256 dist_sq = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+			append_hits((unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(dist_sq, _mm256_load_ps(limit_sq + i), _CMP_LT_OQ)), ids + i, hits);
+		}
+#elif defined(NARROWPHASE_SSE2)
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 x = _mm_load_ps(dx + i);
+			__m128 y = _mm_load_ps(dy + i);
+			__m128 dist_sq = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+			append_hits((unsigned int)_mm_movemask_ps(_mm_cmplt_ps(dist_sq, _mm_load_ps(limit_sq + i))), ids + i, hits);
+		}
+#endif
+		// Remaining tests that do not fill a whole SIMD register
+		for (; i < n; i++)
+			if (dx[i] * dx[i] + dy[i] * dy[i] < limit_sq[i])
+				hits.push_back(ids[i]);
+	}
+
+	// The offset of the circle from the nearest point of the box is max(|offset| - half_size, 0) per axis
+	void run_box_tests(const unsigned int* ids, const float* dx, const float* dy, const float* half_x, const float* half_y, const float* radius_sq, size_t n, std::vector<unsigned int>& hits)
+	{
+		size_t i = 0;
+#if defined(__AVX2__)
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 x = _mm256_max_ps(_mm256_sub_ps(_mm256_and_ps(_mm256_load_ps(dx + i), abs_mask), _mm256_load_ps(half_x + i)), zero);
+			__m256 y = _mm256_max_ps(_mm256_sub_ps(_mm256_and_ps(_mm256_load_ps(dy + i), abs_mask), _mm256_load_ps(half_y + i)), zero);
+			__m256 dist_sq = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+			append_hits((unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(dist_sq, _mm256_load_ps(radius_sq + i), _CMP_LE_OQ)), ids + i, hits);
+		}
+#elif defined(NARROWPHASE_SSE2)
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 x = _mm_max_ps(_mm_sub_ps(_mm_and_ps(_mm_load_ps(dx + i), abs_mask), _mm_load_ps(half_x + i)), zero);
+			__m128 y = _mm_max_ps(_mm_sub_ps(_mm_and_ps(_mm_load_ps(dy + i), abs_mask), _mm_load_ps(half_y + i)), zero);
+			__m128 dist_sq = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+			append_hits((unsigned int)_mm_movemask_ps(_mm_cmple_ps(dist_sq, _mm_load_ps(radius_sq + i))), ids + i, hits);
+		}
+#endif
+		// Remaining tests that do not fill a whole SIMD register
+		for (; i < n; i++)
+		{
+			float x = std::max(std::fabs(dx[i]) - half_x[i], 0.f);
+			float y = std::max(std::fabs(dy[i]) - half_y[i], 0.f);
+			if (x * x + y * y <= radius_sq[i])
+				hits.push_back(ids[i]);
+		}
+	}
+}
+
+void BatchNarrowphase::run(std::vector<unsigned int>& hits) const
+{
+	hits.clear();
+	run_distance_tests(distance.ids.data(), distance.dx.data(), distance.dy.data(), distance.limit_sq.data(), distance.ids.size(), hits);
+	run_box_tests(box.ids.data(), box.dx.data(), box.dy.data(), box.half_x.data(), box.half_y.data(), box.radius_sq.data(), box.ids.size(), hits);
+}
+
+void BatchNarrowphase::clear()
+{
+	distance.ids.clear();
+	distance.dx.clear();
+	distance.dy.clear();
+	distance.limit_sq.clear();
+	box.ids.clear();
+	box.dx.clear();
+	box.dy.clear();
+	box.half_x.clear();
+	box.half_y.clear();
+	box.radius_sq.clear();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+
+#include "common.hpp"
+#include "aligned_allocator.hpp"
+
+// Batched narrowphase, the caller queues the candidate pairs of a step as offsets between their centers and
+// run() evaluates 8 (AVX2) or 4 (SSE) tests per instruction on squared distances, without sqrt or branches.
+// Every queued test carries an id chosen by the caller, e.g., the index of the candidate pair, and run()
+// writes the ids of the tests that hit as a compacted list. All arrays keep their capacity between steps.
+class BatchNarrowphase
+{
+public:
+	typedef std::vector<float, AlignedAllocator<float, 32>> FloatArray;
+
+	// Hit if |offset|^2 < limit_sq, e.g., two circles with limit_sq = (r1 + r2)^2
+	void add_distance_test(unsigned int id, vec2 offset, float limit_sq)
+	{
+		distance.ids.push_back(id);
+		distance.dx.push_back(offset.x);
+		distance.dy.push_back(offset.y);
+		distance.limit_sq.push_back(limit_sq);
+	}
+
+	// Hit if a circle of squared radius 'radius_sq' at 'offset' from the center of an axis-aligned box of
+	// half size 'half_size' touches the box
+	void add_box_test(unsigned int id, vec2 offset, vec2 half_size, float radius_sq)
+	{
+		box.ids.push_back(id);
+		box.dx.push_back(offset.x);
+		box.dy.push_back(offset.y);
+		box.half_x.push_back(half_size.x);
+		box.half_y.push_back(half_size.y);
+		box.radius_sq.push_back(radius_sq);
+	}
+
+	size_t size() const { return distance.ids.size() + box.ids.size(); }
+
+	// Replace 'hits' by the ids of all queued tests that hit, the distance tests first, each in queued order
+	void run(std::vector<unsigned int>& hits) const;
+
+	// Forget the queued tests
+	void clear();
+
+private:
+	struct DistanceTests
+	{
+		std::vector<unsigned int> ids;
+		FloatArray dx, dy, limit_sq;
+	} distance;
+
+	struct BoxTests
+	{
+		std::vector<unsigned int> ids;
+		FloatArray dx, dy, half_x, half_y, radius_sq;
+	} box;
+};
@@ -1,6 +1,35 @@
 // internal
 #include "physics_system.hpp"
 #include "world_init.hpp"
+#include "command_buffer.hpp"
+
+// SIMD intrinsics, AVX2 is only used when the compiler targets it (see SALMON_AVX2 in CMakeLists.txt)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PHYSICS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+	// position[i] += velocity[i] * step for 'n' floats, the x and y of every Motion field are adjacent
+	// The arrays carry no alignment guarantee beyond float, so the loads are unaligned.
+	void integrate_positions(float* position, const float* velocity, size_t n, float step)
+	{
+		size_t i = 0;
+#if defined(__AVX2__)
+		const __m256 step8 = _mm256_set1_ps(step);
+		for (; i + 8 <= n; i += 8)
+			_mm256_storeu_ps(position + i, _mm256_add_ps(_mm256_loadu_ps(position + i), _mm256_mul_ps(_mm256_loadu_ps(velocity + i), step8)));
+#elif defined(PHYSICS_SSE2)
+		const __m128 step4 = _mm_set1_ps(step);
+		for (; i + 4 <= n; i += 4)
+			_mm_storeu_ps(position + i, _mm_add_ps(_mm_loadu_ps(position + i), _mm_mul_ps(_mm_loadu_ps(velocity + i), step4)));
+#endif
+		for (; i < n; i++)
+			position[i] += velocity[i] * step;
+	}
+}
 
 // Returns the local bounding coordinates scaled by the current size of the entity
 vec2 get_bounding_box(const Motion& motion)
@@ -9,54 +38,68 @@ vec2 get_bounding_box(const Motion& motion)
 	return { abs(motion.scale.x), abs(motion.scale.y) };
 }
 
-// This is a SUPER APPROXIMATE check that puts a circle around the bounding boxes and sees
-// if the center point of either object is inside the other's bounding-box-circle. You can
-// surely implement a more accurate detection
-bool collides(const Motion& motion1, const Motion& motion2)
-{
-	vec2 dp = motion1.position - motion2.position;
-	float dist_squared = dot(dp,dp);
-	const vec2 other_bonding_box = get_bounding_box(motion1) / 2.f;
-	const float other_r_squared = dot(other_bonding_box, other_bonding_box);
-	const vec2 my_bonding_box = get_bounding_box(motion2) / 2.f;
-	const float my_r_squared = dot(my_bonding_box, my_bonding_box);
-	const float r_squared = max(other_r_squared, my_r_squared);
-	if (dist_squared < r_squared)
-		return true;
-	return false;
+// The narrowphase shapes, rocks are circles and the salmon is a rectangle, see PhysicsSystem::queue_narrowphase()
+const float ROCK_RADIUS = 50.f;
+const vec2 SALMON_HALF_SIZE = { 50.f, 25.f };
+
+// Penetration of the rock circle (radius 50) into the salmon rectangle (100 x 50)
+float circleAndRectangleDepth(const Motion& playerMotion, const Motion& rockMotion) {
+	vec2 offset = rockMotion.position - playerMotion.position;
+	vec2 closest = clamp(offset, -SALMON_HALF_SIZE, SALMON_HALF_SIZE);
+	return ROCK_RADIUS - length(offset - closest);
 }
 
-// calculate Rock - Rock collisions
-bool circlesCollide(const Motion& motion1, const Motion& motion2) {
-	float dist = sqrt(pow(motion1.position.x - motion2.position.x, 2) + pow(motion1.position.y - motion2.position.y, 2));
-	if (dist < 50) {
-		return true;
-	}
-	return false;
+// Report a contact with the normal pointing from the first to the second center
+void addContact(ContactBuffer& contacts, Entity entity_a, Entity entity_b, const Motion& motion_a, const Motion& motion_b, float depth) {
+	vec2 dp = motion_b.position - motion_a.position;
+	float dist = length(dp);
+	contacts.add(entity_a, entity_b, dist > 0 ? dp / dist : vec2(1, 0), depth);
 }
 
-// calculate Player - Rock collisions
-// source: https://stackoverflow.com/questions/401847/circle-rectangle-collision-detection-intersection
-bool circleAndRectangleCollide(const Motion& playerMotion, const Motion& rockMotion) {
-	// salmon rectangle will have width of 100, height of 50
-	float circleDistanceX = abs(rockMotion.position.x - playerMotion.position.x);
-	if (circleDistanceX > 50 + 50) return false; // half rect width + circle radius
-	float circleDistanceY = abs(rockMotion.position.y - playerMotion.position.y);
-	if (circleDistanceY > 25 + 50) return false; // half rect height + circle radius
+// The narrowphase tests with fixed sizes reach further than the bounding circle of small entities:
+// two rocks touch within 50 and a rock touches the salmon rectangle within 50 + sqrt(50^2 + 25^2) < 2 * 62.5
+const float MIN_BROADPHASE_RADIUS = 62.5f;
+
+// Number of candidate pairs per chunk of the parallel narrowphase
+const size_t COLLISION_GRAIN = 2048;
 
-	if (circleDistanceX <= 50) return true; // half rect width
-	if (circleDistanceY <= 25) return true; // half rect height
+// Which narrowphase test applies to an entity
+enum BodyShape : uint8_t {
+	BODY_OTHER = 0,
+	BODY_SOFT_SHELL = 1,
+	BODY_PLAYER = 2
+};
 
-	float cornerDistSqrd = pow(circleDistanceX - 50, 2) + pow(circleDistanceY - 25, 2);
-	return (cornerDistSqrd <= pow(50, 2));
+// Report the contact of a pair the narrowphase found touching, the shapes decide the depth as they decided the test
+void addPairContact(ContactBuffer& contacts, Entity entity_i, Entity entity_j, const Motion& motion_i, const Motion& motion_j, uint8_t shape_i, uint8_t shape_j) {
+	if ((shape_i & BODY_SOFT_SHELL) && (shape_j & BODY_SOFT_SHELL)) {
+		// rocks are colliding, they touch within one rock radius
+		addContact(contacts, entity_i, entity_j, motion_i, motion_j, ROCK_RADIUS - length(motion_j.position - motion_i.position));
+	}
+	else if ((shape_i & BODY_PLAYER) && (shape_j & BODY_SOFT_SHELL)) {
+		addContact(contacts, entity_i, entity_j, motion_i, motion_j, circleAndRectangleDepth(motion_i, motion_j));
+	}
+	else if ((shape_i & BODY_SOFT_SHELL) && (shape_j & BODY_PLAYER)) {
+		addContact(contacts, entity_i, entity_j, motion_i, motion_j, circleAndRectangleDepth(motion_j, motion_i));
+	}
+	else {
+		// The bounding circle of the larger entity decides
+		const float radius = max(length(get_bounding_box(motion_i) / 2.f), length(get_bounding_box(motion_j) / 2.f));
+		addContact(contacts, entity_i, entity_j, motion_i, motion_j, radius - length(motion_j.position - motion_i.position));
+	}
 }
 
-void handleMeshWallCollisions(Entity e, float window_height_px, float window_width_px) {
+// Mark the center of an entity, recorded in debug mode and created at the sync point
+void createCenterLine(const vec2& center) {
+	createLine(center, { 5,5 });
+}
+
+// Returns whether the velocity changed
+bool handleMeshWallCollisions(Entity e, Mesh* salmonMeshPointer, MotionRef salmonMotion, float window_height_px, float window_width_px) {
 	if (registry.deathTimers.has(e)) {
-		return;
+		return false;
 	}
-	Mesh* salmonMeshPointer = registry.meshPtrs.get(e);
-	Motion& salmonMotion = registry.motions.get(e);
+	const vec2 velocity = salmonMotion.velocity;
 	Transform transform;
 	transform.translate(salmonMotion.position);
 	transform.rotate(salmonMotion.angle);
@@ -88,71 +131,129 @@ void handleMeshWallCollisions(Entity e, float window_height_px, float window_wid
 			salmonMotion.velocity.x *= -1;
 		}
 	}
+	return salmonMotion.velocity != velocity;
+}
+
+void PhysicsSystem::integrate_bodies(float step_seconds)
+{
+	ComponentContainer<Motion>& motions = registry.motions;
+	ComponentContainer<Motion>::Array& fields = motions.components;
+	const size_t count = motions.size();
+	body_x.resize(count);
+	body_y.resize(count);
+	body_key.resize(count);
+	body_radius.resize(count);
+	body_bound_sq.resize(count);
+	body_shape.resize(count);
+	body_changed.resize(count);
+	ThreadPool::shared().parallel_for(count, PARALLEL_GRAIN, [&](size_t begin, size_t end)
+	{
+		// The positions of the whole range in one pass over the field arrays
+		integrate_positions(&fields.position[begin].x, &fields.velocity[begin].x, 2 * (end - begin), step_seconds);
+		for (size_t i = begin; i < end; i++)
+		{
+			// Only entities that actually moved are marked as changed, static ones stay clean
+			const vec2 velocity = fields.velocity[i];
+			body_changed[i] = velocity.x != 0.f || velocity.y != 0.f;
+
+			const vec2 position = fields.position[i];
+			body_x[i] = position.x;
+			body_y[i] = position.y;
+			const vec2 half_box = 0.5f * abs(fields.scale[i]); // see get_bounding_box()
+			body_bound_sq[i] = dot(half_box, half_box);
+			body_radius[i] = max(sqrt(body_bound_sq[i]), MIN_BROADPHASE_RADIUS);
+			Entity e = motions.entities[i];
+			body_key[i] = e;
+			body_shape[i] = (registry.softShells.has(e) ? BODY_SOFT_SHELL : 0) | (registry.players.has(e) ? BODY_PLAYER : 0);
+		}
+	});
+}
+
+void PhysicsSystem::queue_narrowphase(BatchNarrowphase& narrowphase, size_t begin, size_t end) const
+{
+	narrowphase.clear();
+	for (uint k = (uint)begin; k < end; k++)
+	{
+		const uint i = candidates[k].first;
+		const uint j = candidates[k].second;
+		const vec2 offset = { body_x[j] - body_x[i], body_y[j] - body_y[i] };
+		const uint8_t shape_i = body_shape[i];
+		const uint8_t shape_j = body_shape[j];
+		if ((shape_i & BODY_SOFT_SHELL) && (shape_j & BODY_SOFT_SHELL))
+			narrowphase.add_distance_test(k, offset, ROCK_RADIUS * ROCK_RADIUS);
+		else if (((shape_i & BODY_PLAYER) && (shape_j & BODY_SOFT_SHELL)) || ((shape_i & BODY_SOFT_SHELL) && (shape_j & BODY_PLAYER)))
+			narrowphase.add_box_test(k, offset, SALMON_HALF_SIZE, ROCK_RADIUS * ROCK_RADIUS); // symmetric in the offset
+		else
+			// The center of either entity is inside the bounding circle of the larger one
+			narrowphase.add_distance_test(k, offset, max(body_bound_sq[i], body_bound_sq[j]));
+	}
 }
 
 void PhysicsSystem::step(float elapsed_ms, float window_width_px, float window_height_px)
 {
 	// Move fish based on how much time has passed, this is to (partially) avoid
 	// having entities move at different speed based on the machine.
-	auto& motion_registry = registry.motions;
-	for(uint i = 0; i< motion_registry.size(); i++)
-	{
-		// !!! TODO A1: update motion.position based on step_seconds and motion.velocity
-		Motion& motion = motion_registry.components[i];
-		Entity entity = motion_registry.entities[i];
-		float step_seconds = 1.0f * (elapsed_ms / 1000.f);
-		motion.position += motion.velocity * step_seconds;
-	}
+	// The same pass gathers the positions and bounds for the collision detection below
+	float step_seconds = 1.0f * (elapsed_ms / 1000.f);
+	integrate_bodies(step_seconds);
 
 	// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 	// TODO A3: HANDLE PEBBLE UPDATES HERE
 	// DON'T WORRY ABOUT THIS UNTIL ASSIGNMENT 3
 	// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 
-	// Check for collisions between all moving entities
+	// Check for collisions between all moving entities, the broadphase reports every overlapping unordered pair once
+	// Both the broadphase and the narrowphase split their work across the worker threads
+	contacts.clear();
     ComponentContainer<Motion> &motion_container = registry.motions;
-	for(uint i = 0; i<motion_container.components.size(); i++)
+	broadphase.find_pairs(body_key.data(), body_x.data(), body_y.data(), body_radius.data(), (unsigned int)body_key.size(), candidates);
+	const size_t chunk_count = (candidates.size() + COLLISION_GRAIN - 1) / COLLISION_GRAIN;
+	if (collision_chunks.size() < chunk_count)
+		collision_chunks.resize(chunk_count);
+	ThreadPool::shared().parallel_for(chunk_count, 1, [&](size_t first_chunk, size_t last_chunk)
 	{
-		Motion& motion_i = motion_container.components[i];
-		Entity entity_i = motion_container.entities[i];
-		for(uint j = 0; j<motion_container.components.size(); j++) // i+1
+		for (size_t c = first_chunk; c < last_chunk; c++)
 		{
-			if (i == j)
-				continue;
-
-			Motion& motion_j = motion_container.components[j];
-			Entity entity_j = motion_container.entities[j];
-			if (registry.softShells.has(entity_i) && registry.softShells.has(entity_j)) {
-				// rocks are colliding, use circles to calcualte collisions
-				if (circlesCollide(motion_i, motion_j)) {
-					registry.collisions.emplace_with_duplicates(entity_i, entity_j);
-				}
-			}
-			else if (registry.players.has(entity_i) && registry.softShells.has(entity_j)) {
-				if (circleAndRectangleCollide(motion_i, motion_j)) {
-					registry.collisions.emplace_with_duplicates(entity_i, entity_j);
-				}
-			}
-			else if (registry.softShells.has(entity_i) && registry.players.has(entity_j)) {
-				if (circleAndRectangleCollide(motion_j, motion_i)) {
-					registry.collisions.emplace_with_duplicates(entity_i, entity_j);
-				}
-			}
-			else if (collides(motion_i, motion_j)) {				
-				// Create a collisions event
-				// We are abusing the ECS system a bit in that we potentially insert muliple collisions for the same entity
-				registry.collisions.emplace_with_duplicates(entity_i, entity_j);
-				//registry.collisions.emplace_with_duplicates(entity_j, entity_i);
+			CollisionChunk& chunk = collision_chunks[c];
+			queue_narrowphase(chunk.narrowphase, c * COLLISION_GRAIN, min((c + 1) * COLLISION_GRAIN, candidates.size()));
+			chunk.narrowphase.run(chunk.hits);
+			chunk.contacts.clear();
+			for (uint k : chunk.hits)
+			{
+				uint i = candidates[k].first;
+				uint j = candidates[k].second;
+				addPairContact(chunk.contacts, motion_container.entities[i], motion_container.entities[j],
+					motion_container.components[i], motion_container.components[j], body_shape[i], body_shape[j]);
 			}
 		}
-	}
+	});
+	// Merging in chunk order and sorting by pair gives the same contacts in the same order on any number of threads
+	for (size_t c = 0; c < chunk_count; c++)
+		contacts.append(collision_chunks[c].contacts);
+	contacts.finish();
 
-	// handle rock - wall collisions here
-	for (Entity e : registry.softShells.entities) {
-		handleMeshWallCollisions(e, window_height_px, window_width_px);
-	}
-	// handle player - wall collisions here
-	handleMeshWallCollisions(registry.players.entities[0], window_height_px, window_width_px);
+	// handle rock - wall and player - wall collisions here
+	// Every entity only bounces its own motion, so the Motion slots are split across the worker threads
+	ThreadPool::shared().parallel_for(body_shape.size(), PARALLEL_GRAIN, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			Entity e = motion_container.entities[i];
+			if (body_shape[i] == BODY_OTHER || !registry.meshPtrs.has(e))
+				continue;
+			Mesh* mesh = registry.meshPtrs.read(e);
+			if ((body_shape[i] & BODY_SOFT_SHELL) && handleMeshWallCollisions(e, mesh, motion_container.components[i], window_height_px, window_width_px))
+				body_changed[i] = 1;
+			if ((body_shape[i] & BODY_PLAYER) && handleMeshWallCollisions(e, mesh, motion_container.components[i], window_height_px, window_width_px))
+				body_changed[i] = 1;
+		}
+	});
+
+	// The passes above wrote to the Motion components through the dense arrays, the changed ones are
+	// marked here so that the on_update listeners run on this thread and not on the worker threads
+	for (uint i = 0; i < body_changed.size(); i++)
+		if (body_changed[i])
+			motion_container.touch_slot(i);
 
 	// you may need the following quantities to compute wall positions
 	(float)window_width_px; (float)window_height_px;
@@ -166,10 +267,10 @@ void PhysicsSystem::step(float elapsed_ms, float window_width_px, float window_h
 	// debugging of bounding boxes
 	if (debugging.in_debug_mode)
 	{
-		uint size_before_adding_new = (uint)motion_container.components.size();
-		for (uint i = 0; i < size_before_adding_new; i++)
+		// The lines are created at the sync point, creating them here would grow the container we iterate
+		for (uint i = 0; i < motion_container.components.size(); i++)
 		{
-			Motion& motion_i = motion_container.components[i];
+			const Motion motion_i = motion_container.components[i];
 			Entity entity_i = motion_container.entities[i];
 
 			// visualize the radius with two axis-aligned lines
@@ -180,7 +281,8 @@ void PhysicsSystem::step(float elapsed_ms, float window_width_px, float window_h
 			vec2 line_scale2 = { 2*radius, motion_i.scale.x / 10};
 			Entity line2 = createLine(motion_i.position, line_scale2);*/
 			
-			Entity center = createLine(motion_i.position, { 5,5 });
+			vec2 center = motion_i.position;
+			commands.call(&createCenterLine, center);
 
 			// !!! TODO A2: implement debugging of bounding boxes and mesh
 		}
@@ -4,6 +4,9 @@
 #include "tiny_ecs.hpp"
 #include "components.hpp"
 #include "tiny_ecs_registry.hpp"
+#include "contact_buffer.hpp"
+#include "broadphase.hpp"
+#include "narrowphase.hpp"
 
 // A simple physics system that moves rigid bodies and checks for collision
 class PhysicsSystem
@@ -14,4 +17,47 @@ public:
 	PhysicsSystem()
 	{
 	}
+
+	// Switch the broadphase algorithm, e.g., to compare them on the current level
+	void set_broadphase(BROADPHASE_ID id) { broadphase.select(id); }
+	BROADPHASE_ID get_broadphase() const { return broadphase.selected_id(); }
+
+	// The contacts of the last step, sorted by entity pair
+	const ContactBuffer& get_contacts() const { return contacts; }
+
+private:
+	// Re-used every step, cleared at the start of the collision detection
+	ContactBuffer contacts;
+
+	// Broadphase over the bounding circles of all moving entities
+	Broadphase broadphase;
+
+	// The candidate pairs are tested in chunks on the worker threads, each chunk with its own batched tests,
+	// hits (indices into 'candidates') and contacts. The chunks are merged in order and then sorted by pair.
+	struct CollisionChunk
+	{
+		BatchNarrowphase narrowphase;
+		std::vector<unsigned int> hits;
+		ContactBuffer contacts;
+	};
+	std::vector<CollisionChunk> collision_chunks;
+
+	// Per Motion slot, the integrated position, the radius the broadphase uses, the squared radius of the
+	// bounding circle, and which shapes the narrowphase tests, re-used every step
+	std::vector<float> body_x;
+	std::vector<float> body_y;
+	std::vector<unsigned int> body_key;
+	std::vector<float> body_radius;
+	std::vector<float> body_bound_sq;
+	std::vector<uint8_t> body_shape;
+	// Set for the slots whose Motion was written this step, they are marked as changed at the end of step()
+	std::vector<uint8_t> body_changed;
+	std::vector<CandidatePair> candidates;
+
+	// Advance every Motion by its velocity and fill the per-slot arrays in the same pass over the container,
+	// split across the worker threads
+	void integrate_bodies(float step_seconds);
+
+	// Queue the test that applies to the shapes of the candidate pairs [begin, end)
+	void queue_narrowphase(BatchNarrowphase& narrowphase, size_t begin, size_t end) const;
 };
\ No newline at end of file
@@ -4,10 +4,8 @@
 
 #include "tiny_ecs_registry.hpp"
 
-void RenderSystem::drawTexturedMesh(Entity entity,
-									const mat3 &projection)
+Transform RenderSystem::createTransform(const Motion &motion)
 {
-	Motion &motion = registry.motions.get(entity);
 	// Transformation code, see Rendering and Transformation in the template
 	// specification for more info Incrementally updates transformation matrix,
 	// thus ORDER IS IMPORTANT
@@ -16,10 +14,14 @@ void RenderSystem::drawTexturedMesh(Entity entity,
 	transform.scale(motion.scale);
 	// !!! TODO A1: add rotation to the chain of transformations, mind the order
 	// of transformations
+	return transform;
+}
 
-	assert(registry.renderRequests.has(entity));
-	const RenderRequest &render_request = registry.renderRequests.get(entity);
-
+void RenderSystem::drawTexturedMesh(Entity entity,
+									const Transform &transform,
+									const RenderRequest &render_request,
+									const mat3 &projection)
+{
 	const GLuint used_effect_enum = (GLuint)render_request.used_effect;
 	assert(used_effect_enum != (GLuint)EFFECT_ASSET_ID::EFFECT_COUNT);
 	const GLuint program = (GLuint)effects[used_effect_enum];
@@ -59,9 +61,8 @@ void RenderSystem::drawTexturedMesh(Entity entity,
 		glActiveTexture(GL_TEXTURE0);
 		gl_has_errors();
 
-		assert(registry.renderRequests.has(entity));
 		GLuint texture_id =
-			texture_gl_handles[(GLuint)registry.renderRequests.get(entity).used_texture];
+			texture_gl_handles[(GLuint)render_request.used_texture];
 
 		glBindTexture(GL_TEXTURE_2D, texture_id);
 		gl_has_errors();
@@ -100,7 +101,7 @@ void RenderSystem::drawTexturedMesh(Entity entity,
 
 	// Getting uniform locations for glUniform* calls
 	GLint color_uloc = glGetUniformLocation(program, "fcolor");
-	const vec3 color = registry.colors.has(entity) ? registry.colors.get(entity) : vec3(1);
+	const vec3 color = registry.colors.has(entity) ? registry.colors.read(entity) : vec3(1);
 	glUniform3fv(color_uloc, 1, (float *)&color);
 	gl_has_errors();
 
@@ -160,7 +161,9 @@ void RenderSystem::drawToScreen()
 	GLuint time_uloc = glGetUniformLocation(water_program, "time");
 	GLuint dead_timer_uloc = glGetUniformLocation(water_program, "darken_screen_factor");
 	glUniform1f(time_uloc, (float)(glfwGetTime() * 10.0f));
-	ScreenState &screen = registry.screenStates.get(screen_state_entity);
+	// The screen state is the only one, its handle is re-issued whenever the world is restored from a snapshot
+	assert(registry.screenStates.size() == 1);
+	const ScreenState &screen = registry.screenStates.components[0];
 	glUniform1f(dead_timer_uloc, screen.darken_screen_factor);
 	gl_has_errors();
 	// Set the vertex position and vertex texture coordinates (both stored in the
@@ -185,7 +188,15 @@ void RenderSystem::drawToScreen()
 
 // Render our game world
 // http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-14-render-to-texture/
-void RenderSystem::draw()
+// Interpolate between two angles along the shorter arc, e.g., from 350 to 10 degrees through 0 and not 180
+static float mixAngle(float from, float to, float alpha)
+{
+	float delta = to - from;
+	delta -= 2.f * M_PI * floor((delta + M_PI) / (2.f * M_PI));
+	return from + delta * alpha;
+}
+
+void RenderSystem::draw(float alpha)
 {
 	// Getting size of window
 	int w, h;
@@ -208,14 +219,29 @@ void RenderSystem::draw()
 	gl_has_errors();
 	mat3 projection_2D = createProjectionMatrix();
 	// Draw all textured meshes that have a position and size component
-	for (Entity entity : registry.renderRequests.entities)
+	// The group keeps the Motion and RenderRequest of slot i at index i of both containers
+	OwningGroup<Motion, RenderRequest> &drawables = registry.drawables;
+	const Entity *entities = drawables.entities();
+	const ComponentContainer<Motion>::Array& motions = drawables.components<Motion>();
+	const ComponentContainer<RenderRequest>::Array& render_requests = drawables.components<RenderRequest>();
+	transforms.resize(drawables.size());
+	// The transforms do not touch OpenGL, so they are built in parallel
+	ThreadPool::shared().parallel_for(drawables.size(), PARALLEL_GRAIN, [&](size_t begin, size_t end)
 	{
-		if (!registry.motions.has(entity))
-			continue;
-		// Note, its not very efficient to access elements indirectly via the entity
-		// albeit iterating through all Sprites in sequence. A good point to optimize
-		drawTexturedMesh(entity, projection_2D);
-	}
+		for (size_t i = begin; i < end; i++)
+		{
+			// Entities created in the last step have no previous state yet and are drawn where they are
+			Motion motion = motions[i];
+			if (const PreviousMotion* previous = registry.previous_motion(entities[i]))
+			{
+				motion.position = mix(previous->position, motion.position, alpha);
+				motion.angle = mixAngle(previous->angle, motion.angle, alpha);
+			}
+			transforms[i] = createTransform(motion);
+		}
+	});
+	for (size_t i = 0; i < drawables.size(); i++)
+		drawTexturedMesh(entities[i], transforms[i], render_requests[i], projection_2D);
 
 	// Truely render to the screen
 	drawToScreen();
@@ -2,6 +2,7 @@
 
 #include <array>
 #include <utility>
+#include <vector>
 
 #include "common.hpp"
 #include "components.hpp"
@@ -70,14 +71,19 @@ public:
 	~RenderSystem();
 
 	// Draw all entities
-	void draw();
+	// 'alpha' interpolates every Motion from its PreviousMotion (0) to its current value (1)
+	void draw(float alpha = 1.f);
 
 	mat3 createProjectionMatrix();
 
 private:
 	// Internal drawing functions for each entity type
-	void drawTexturedMesh(Entity entity, const mat3& projection);
+	void drawTexturedMesh(Entity entity, const Transform& transform, const RenderRequest& render_request, const mat3& projection);
 	void drawToScreen();
+	static Transform createTransform(const Motion& motion);
+
+	// The transform of every slot of the drawables group, built on the worker threads before the draw calls are issued
+	std::vector<Transform> transforms;
 
 	// Window handle
 	GLFWwindow* window;
@@ -88,8 +94,6 @@ private:
 	GLuint frame_buffer;
 	GLuint off_screen_render_buffer_color;
 	GLuint off_screen_render_buffer_depth;
-
-	Entity screen_state_entity;
 };
 
 bool loadEffectFromFile(
@@ -141,6 +141,9 @@ void RenderSystem::initializeGlGeometryBuffers()
 	// Index and Vertex buffer data initialization.
 	initializeGlMeshes();
 
+	// Snapshots store Mesh* components as the geometry id they point to in this array
+	SnapshotFormat<Mesh*>::meshes = meshes.data();
+
 	//////////////////////////
 	// Initialize sprite
 	// The position corresponds to the center of the texture.
@@ -239,13 +242,14 @@ RenderSystem::~RenderSystem()
 	gl_has_errors();
 
 	// remove all entities created by the render system
-	while (registry.renderRequests.entities.size() > 0)
-	    registry.remove_all_components_of(registry.renderRequests.entities.back());
+	registry.remove_all_components_of(registry.renderRequests.entities);
 }
 
 // Initialize the screen texture from a standard sprite
 bool RenderSystem::initScreenTexture()
 {
+	// The only ScreenState, it is looked up by position since restoring the world re-issues its handle
+	Entity screen_state_entity;
 	registry.screenStates.emplace(screen_state_entity);
 
 	int width, height;
@@ -0,0 +1,95 @@
+// internal
+#include "thread_pool.hpp"
+
+// stlib
+#include <algorithm>
+
+namespace {
+	// Set while the thread executes ranges of a job, nested parallel_for calls then run inline
+	thread_local bool in_job = false;
+}
+
+ThreadPool::ThreadPool(unsigned int worker_count)
+	: next_begin(0)
+{
+	for (unsigned int i = 0; i < worker_count; i++)
+		workers.emplace_back([this]() { worker_loop(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+	return pool;
+}
+
+bool ThreadPool::inside_job()
+{
+	return in_job;
+}
+
+void ThreadPool::run_ranges(const RangeFunction& fn, size_t count, size_t grain)
+{
+	in_job = true;
+	for (size_t begin = next_begin.fetch_add(grain); begin < count; begin = next_begin.fetch_add(grain))
+		fn.call(fn.context, begin, std::min(begin + grain, count));
+	in_job = false;
+}
+
+void ThreadPool::run(size_t count, size_t grain, const RangeFunction& fn)
+{
+	std::lock_guard<std::mutex> serialize(run_mutex);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &fn;
+		job_count = count;
+		job_grain = grain;
+		next_begin = 0;
+		busy_workers = (unsigned int)workers.size();
+		job_generation++;
+	}
+	wake.notify_all();
+
+	run_ranges(fn, count, grain);
+
+	// Every worker checks in once, so the next job cannot start while one is still reading this one
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this]() { return busy_workers == 0; });
+	job = nullptr;
+}
+
+void ThreadPool::worker_loop()
+{
+	unsigned int seen_generation = 0;
+	while (true)
+	{
+		const RangeFunction* fn;
+		size_t count, grain;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&]() { return stopping || job_generation != seen_generation; });
+			if (stopping)
+				return;
+			seen_generation = job_generation;
+			fn = job;
+			count = job_count;
+			grain = job_grain;
+		}
+
+		run_ranges(*fn, count, grain);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busy_workers == 0)
+			done.notify_one();
+	}
+}
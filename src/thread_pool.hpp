@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Default number of elements per range handed to a worker, smaller loops run on the calling thread
+const size_t PARALLEL_GRAIN = 1024;
+
+// A fixed set of worker threads that split index ranges between them, see parallel_for()
+// The calling thread works on the ranges as well and only returns once all of them are done.
+class ThreadPool
+{
+	// The function of a job without type erasure through std::function, which may allocate on every call.
+	// 'context' points to the caller's function object, which outlives the job as run() blocks until it is done.
+	struct RangeFunction
+	{
+		void (*call)(void* context, size_t begin, size_t end);
+		void* context;
+	};
+
+	template <typename Function>
+	static void call_range(void* context, size_t begin, size_t end)
+	{
+		(*static_cast<Function*>(context))(begin, end);
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	std::mutex run_mutex; // one parallel_for at a time
+
+	// The current job, guarded by mutex except for the range counter
+	const RangeFunction* job = nullptr;
+	size_t job_count = 0;
+	size_t job_grain = 0;
+	std::atomic<size_t> next_begin;
+	unsigned int job_generation = 0;
+	unsigned int busy_workers = 0;
+	bool stopping = false;
+
+	void worker_loop();
+	void run_ranges(const RangeFunction& fn, size_t count, size_t grain);
+	void run(size_t count, size_t grain, const RangeFunction& fn);
+public:
+	explicit ThreadPool(unsigned int worker_count);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// The pool shared by all systems, one worker per hardware thread besides the main thread
+	// The workers are only started on first use
+	static ThreadPool& shared();
+
+	// Number of threads working on a parallel_for, including the calling one
+	unsigned int thread_count() const { return (unsigned int)workers.size() + 1; }
+
+	// Calls fn(begin, end) for consecutive ranges of at most 'grain' indices covering [0, count)
+	// The ranges run concurrently, so fn must only write to data owned by its range.
+	// Calls from inside fn run on the calling thread.
+	template <typename Function>
+	void parallel_for(size_t count, size_t grain, Function fn)
+	{
+		if (grain == 0)
+			grain = 1;
+		if (count <= grain || workers.empty() || inside_job())
+		{
+			if (count > 0)
+				fn((size_t)0, count);
+			return;
+		}
+		run(count, grain, RangeFunction{ &call_range<Function>, &fn });
+	}
+
+	// True on a thread that currently executes a range
+	static bool inside_job();
+};
@@ -1,5 +1,8 @@
 // internal
 #include "tiny_ecs.hpp"
 
-// All we need to store besides the containers is the id of every entity and callbacks to be able to remove entities across containers
-unsigned int Entity::id_count = 1;
\ No newline at end of file
+// All we need to store besides the containers is the generation of every entity index and the indices free for re-use
+std::vector<unsigned int> Entity::generations(1, 0); // reserve index 0
+std::vector<unsigned int> Entity::free_indices;
+std::vector<unsigned int> Entity::restored_generations;
+unsigned int ContainerInterface::current_version = 1; // 0 means never written
@@ -2,116 +2,974 @@
 
 #include <algorithm>
 #include <vector>
-#include <unordered_map>
 #include <set>
 #include <functional>
 #include <typeindex>
+#include <typeinfo>
+#include <cstdio>
+#include <tuple>
+#include <type_traits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <atomic>
+#include <string>
 #include <assert.h>
+#include "thread_pool.hpp"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif
+
+// Count the get/has/insert/remove calls of every container, see ContainerInterface::accesses()
+// Enabled with the CMake option SALMON_ECS_STATS, otherwise the counters stay 0 and cost nothing
+#ifdef SALMON_ECS_STATS
+#define ECS_COUNT_ACCESS(counter) (counter.fetch_add(1, std::memory_order_relaxed))
+#else
+#define ECS_COUNT_ACCESS(counter) ((void)0)
+#endif
+
+// An entity id packs the index of the entity into its lower bits and a generation counter into the upper bits
+const unsigned int ENTITY_INDEX_BITS = 20;
+const unsigned int ENTITY_INDEX_MASK = (1u << ENTITY_INDEX_BITS) - 1;
+const unsigned int ENTITY_GENERATION_MASK = (1u << (32 - ENTITY_INDEX_BITS)) - 1;
+
+class Snapshot;
 
 // Unique identifyer for all entities
 class Entity
 {
 	unsigned int id;
-	static unsigned int id_count; // starts from 1, entit 0 is the default initialization
+	Entity(unsigned int id, bool) : id(id) {} // copy an existing id without allocating
+	// The current generation of every index handed out so far, index 0 is the default initialization and never handed out
+	static std::vector<unsigned int> generations;
+	// Indices of released entities, re-used before new indices are handed out
+	static std::vector<unsigned int> free_indices;
+	// The generations stored in the last restored snapshot, see restored()
+	static std::vector<unsigned int> restored_generations;
 public:
 	Entity()
 	{
-		id = id_count++;
-		// Note, indices of already deleted entities arent re-used in this simple implementation.
+		unsigned int index;
+		if (!free_indices.empty()) {
+			index = free_indices.back();
+			free_indices.pop_back();
+		}
+		else {
+			index = (unsigned int)generations.size();
+			assert(index <= ENTITY_INDEX_MASK && "Ran out of entity indices");
+			generations.push_back(0);
+		}
+		id = (generations[index] << ENTITY_INDEX_BITS) | index;
+	}
+	operator unsigned int() const { return id; } // this enables automatic casting to int
+
+	// The current handle of an index that was handed out before, e.g., to iterate a bitset of entity indices
+	static Entity from_index(unsigned int index)
+	{
+		assert(index < generations.size());
+		return Entity(generations[index] << ENTITY_INDEX_BITS | index, true);
+	}
+
+	unsigned int index() const { return id & ENTITY_INDEX_MASK; }
+	unsigned int generation() const { return id >> ENTITY_INDEX_BITS; }
+
+	// Capacity hint for the number of entities alive at the same time
+	static void reserve(size_t count)
+	{
+		generations.reserve(count + 1);
+		free_indices.reserve(count);
+	}
+
+	// A handle is stale once its index has been released, e.g., the entity was removed from the registry
+	static bool is_alive(Entity e)
+	{
+		return e.index() < generations.size() && generations[e.index()] == e.generation();
+	}
+
+	// Copy the generations and free indices into a snapshot, see Registry::save()
+	static void save_handles(Snapshot& snapshot);
+	// Re-issue the handles of a snapshot, see Registry::restore()
+	// Every index handed out so far gets a new generation, so no handle from before the restore stays alive.
+	// The entities of the snapshot are alive under their new handles, all other indices are free.
+	static void restore_handles(Snapshot& snapshot);
+
+	// The handle that an entity of the last restored snapshot has now, given its handle when the snapshot was saved
+	static Entity restored(Entity saved)
+	{
+		// A released index was stored with a newer generation than any of its handles
+		assert(saved.index() < restored_generations.size() && restored_generations[saved.index()] == saved.generation()
+			&& "Entity was not alive in the restored snapshot");
+		return from_index(saved.index());
+	}
+
+	// Invalidate all handles to this entity and put its index up for re-use
+	static void release(Entity e)
+	{
+		if (e.index() == 0 || !is_alive(e))
+			return;
+		generations[e.index()] = (generations[e.index()] + 1) & ENTITY_GENERATION_MASK;
+		free_indices.push_back(e.index());
 	}
-	operator unsigned int() { return id; } // this enables automatic casting to int
 };
 
-// Common interface to refer to all containers in the ECS registry
+// One bit per component type of a registry, set for every container an entity is in
+typedef uint64_t ComponentMask;
+
+// Listeners of one kind of container event, see ContainerInterface::on_construct()
+class Signal
+{
+	std::vector<std::pair<unsigned int, std::function<void(Entity)>>> listeners;
+	unsigned int next_id = 0;
+public:
+	// Returns the id to disconnect the listener again
+	unsigned int connect(std::function<void(Entity)> listener)
+	{
+		listeners.emplace_back(next_id, std::move(listener));
+		return next_id++;
+	}
+
+	void disconnect(unsigned int id)
+	{
+		listeners.erase(std::remove_if(listeners.begin(), listeners.end(),
+			[id](const std::pair<unsigned int, std::function<void(Entity)>>& listener) { return listener.first == id; }), listeners.end());
+	}
+
+	void publish(Entity e) const
+	{
+		for (const auto& listener : listeners)
+			listener.second(e);
+	}
+
+	bool empty() const { return listeners.empty(); }
+};
+
+// The signals of a container, only allocated once somebody subscribes
+struct ContainerSignals
+{
+	Signal construct;
+	Signal destroy;
+	Signal update;
+};
+
+// Number of calls to the lookup functions of a container within one frame
+struct AccessCounts
+{
+	unsigned int get = 0;
+	unsigned int has = 0;
+	unsigned int insert = 0;
+	unsigned int remove = 0;
+};
+
+// Memory and access statistics of one container, see Registry::stats()
+struct ContainerStats
+{
+	std::string name;
+	size_t count = 0;        // live components
+	size_t capacity = 0;     // components that fit without reallocating
+	size_t dense_bytes = 0;  // allocated bytes of the component, entity and version arrays
+	size_t index_bytes = 0;  // allocated bytes of the sparse index or bitset
+	float load_factor = 0;   // live components per slot of the sparse index or bitset
+	AccessCounts accesses;   // calls during the last completed frame
+};
+
+// Readable name of a type for debug output
+template <typename T>
+std::string type_name()
+{
+#ifdef __GNUG__
+	int status = 0;
+	char* demangled = abi::__cxa_demangle(typeid(T).name(), nullptr, nullptr, &status);
+	std::string name = (status == 0 && demangled != nullptr) ? demangled : typeid(T).name();
+	free(demangled);
+	return name;
+#else
+	return typeid(T).name();
+#endif
+}
+
+// State shared by all containers, the registry dispatches to the concrete container types at compile time
 struct ContainerInterface
 {
-	virtual void clear() = 0;
-	virtual size_t size() = 0;
-	virtual void remove(Entity e) = 0;
-	virtual bool has(Entity entity) = 0;
+	// Version stamped on every component written in the current frame, advanced by Registry::begin_frame()
+	static unsigned int current_version;
+
+	// Called by the registry, the container keeps its bit in the component mask of every entity up to date
+	void attach_masks(std::vector<ComponentMask>* masks, ComponentMask bit)
+	{
+		entity_masks = masks;
+		mask_bit = bit;
+	}
+
+	// Called after a component was added to an entity, e.g., to maintain a spatial index incrementally
+	Signal& on_construct() { return subscribe().construct; }
+	// Called before a component is removed, it can still be read from the container
+	Signal& on_destroy() { return subscribe().destroy; }
+	// Called after touch(), touch_slot() or patch() marked a component as changed, the listener reads the new value
+	Signal& on_update() { return subscribe().update; }
+
+	// The access counts of the last completed frame, see Registry::begin_frame()
+	const AccessCounts& accesses() const { return last_frame_accesses; }
+
+	// Keep the counts of the finished frame and start counting from 0
+	void end_frame_accesses()
+	{
+		last_frame_accesses.get = get_calls.exchange(0, std::memory_order_relaxed);
+		last_frame_accesses.has = has_calls.exchange(0, std::memory_order_relaxed);
+		last_frame_accesses.insert = insert_calls.exchange(0, std::memory_order_relaxed);
+		last_frame_accesses.remove = remove_calls.exchange(0, std::memory_order_relaxed);
+	}
+
+protected:
+	// The component masks of all entities (indexed by entity index), nullptr for containers outside a registry
+	std::vector<ComponentMask>* entity_masks = nullptr;
+	ComponentMask mask_bit = 0;
+
+	// Without subscribers this stays nullptr and every notification is a single branch
+	// Listeners must not add or remove components of the container that notifies them.
+	std::unique_ptr<ContainerSignals> signals;
+
+	ContainerSignals& subscribe()
+	{
+		if (!signals)
+			signals.reset(new ContainerSignals());
+		return *signals;
+	}
+
+	// Counted with ECS_COUNT_ACCESS, atomic since the parallel loops call has() from the worker threads
+	std::atomic<unsigned int> get_calls{ 0 };
+	std::atomic<unsigned int> has_calls{ 0 };
+	std::atomic<unsigned int> insert_calls{ 0 };
+	std::atomic<unsigned int> remove_calls{ 0 };
+	AccessCounts last_frame_accesses;
+
+	void notify_construct(Entity e) { if (signals) signals->construct.publish(e); }
+	void notify_destroy(Entity e) { if (signals) signals->destroy.publish(e); }
+	void notify_update(Entity e) { if (signals) signals->update.publish(e); }
+
+	void set_mask_bit(Entity e)
+	{
+		if (entity_masks == nullptr)
+			return;
+		if (e.index() >= entity_masks->size())
+			entity_masks->resize(e.index() + 1, 0);
+		(*entity_masks)[e.index()] |= mask_bit;
+	}
+
+	void clear_mask_bit(Entity e)
+	{
+		if (entity_masks != nullptr && e.index() < entity_masks->size())
+			(*entity_masks)[e.index()] &= ~mask_bit;
+	}
+};
+
+template <typename... Components>
+class View;
+
+// Number of the lowest set bit, the word must not be 0
+inline unsigned int lowest_bit_index(uint64_t word)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, word);
+	return (unsigned int)index;
+#else
+	return (unsigned int)__builtin_ctzll(word);
+#endif
+}
+
+// Number of set bits in the word
+inline unsigned int bit_count(uint64_t word)
+{
+#ifdef _MSC_VER
+	return (unsigned int)__popcnt64(word);
+#else
+	return (unsigned int)__builtin_popcountll(word);
+#endif
+}
+
+// Check if the bit of an entity index is set in a bitset
+inline bool bit_is_set(const std::vector<uint64_t>& bits, unsigned int index)
+{
+	return index / 64 < bits.size() && (bits[index / 64] >> (index % 64) & 1) != 0;
+}
+
+// Written at the start of every snapshot to detect restoring something else
+const uint32_t SNAPSHOT_SIGNATURE = 0x53434531; // "ECS1"
+
+// A binary copy of the containers of a registry and of all entity handles, see Registry::save() and Registry::restore()
+// Arrays are stored as raw bytes, so saving and restoring trivially copyable components is one memcpy per array.
+// The buffer keeps its capacity, taking another snapshot into the same object does not allocate.
+class Snapshot
+{
+	std::vector<unsigned char> bytes;
+	size_t read_offset = 0;
+
+	// Arrays start at a multiple of this, so that they can be read in place
+	static const size_t ALIGNMENT = 16;
+
+	static size_t aligned(size_t offset) { return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; }
+
+	void write_raw(const void* data, size_t size)
+	{
+		const unsigned char* first = static_cast<const unsigned char*>(data);
+		bytes.insert(bytes.end(), first, first + size);
+	}
+
+	void read_raw(void* data, size_t size)
+	{
+		assert(read_offset + size <= bytes.size() && "Read past the end of the snapshot");
+		memcpy(data, bytes.data() + read_offset, size);
+		read_offset += size;
+	}
+public:
+	// Discard the contents, but keep the memory for the next snapshot
+	void clear()
+	{
+		bytes.clear();
+		read_offset = 0;
+	}
+
+	// Start reading from the beginning again
+	void rewind() { read_offset = 0; }
+
+	bool empty() const { return bytes.empty(); }
+	size_t size() const { return bytes.size(); }
+
+	template <typename T>
+	void write_value(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable data can be stored in a snapshot");
+		write_raw(&value, sizeof(T));
+	}
+
+	template <typename T>
+	T read_value()
+	{
+		T value;
+		read_raw(&value, sizeof(T));
+		return value;
+	}
+
+	// Append room for 'count' elements and return it, the pointer is valid until the next write
+	template <typename T>
+	T* append_array(size_t count)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable data can be stored in a snapshot");
+		write_value((uint64_t)count);
+		write_value((uint32_t)sizeof(T));
+		size_t offset = aligned(bytes.size());
+		bytes.resize(offset + count * sizeof(T));
+		assert((size_t)bytes.data() % alignof(T) == 0);
+		return reinterpret_cast<T*>(bytes.data() + offset);
+	}
+
+	template <typename T>
+	void write_array(const T* data, size_t count)
+	{
+		T* target = append_array<T>(count);
+		if (count > 0)
+			memcpy(target, data, count * sizeof(T));
+	}
+
+	// Returns the next array in place and sets 'count' to its length, the pointer is valid until the next write
+	template <typename T>
+	const T* read_array(size_t& count)
+	{
+		count = (size_t)read_value<uint64_t>();
+		uint32_t element_size = read_value<uint32_t>();
+		assert(element_size == sizeof(T) && "Snapshot was taken with different component types");
+		(void)element_size;
+		read_offset = aligned(read_offset);
+		assert(read_offset + count * sizeof(T) <= bytes.size() && "Read past the end of the snapshot");
+		const T* data = reinterpret_cast<const T*>(bytes.data() + read_offset);
+		read_offset += count * sizeof(T);
+		return data;
+	}
+};
+
+inline void Entity::save_handles(Snapshot& snapshot)
+{
+	snapshot.write_array(generations.data(), generations.size());
+	snapshot.write_array(free_indices.data(), free_indices.size());
+}
+
+inline void Entity::restore_handles(Snapshot& snapshot)
+{
+	size_t count;
+	const unsigned int* saved = snapshot.read_array<unsigned int>(count);
+	restored_generations.assign(saved, saved + count);
+	size_t free_count;
+	const unsigned int* saved_free = snapshot.read_array<unsigned int>(free_count);
+
+	// Indices that were never handed out before the snapshot are free as well
+	size_t current_count = generations.size();
+	generations.resize(std::max(current_count, count), 0);
+	std::vector<bool> free(generations.size(), false);
+	for (size_t i = count; i < generations.size(); i++)
+		free[i] = true;
+	for (size_t i = 0; i < free_count; i++)
+		free[saved_free[i]] = true;
+
+	// The generations only move forward, a restored entity gets the next generation of its index
+	for (size_t i = 1; i < generations.size(); i++)
+		generations[i] = (std::max(generations[i], i < count ? saved[i] : 0u) + 1) & ENTITY_GENERATION_MASK;
+
+	// Lower indices are re-used first, like after a fresh start
+	free_indices.clear();
+	for (size_t i = generations.size(); i-- > 1;)
+		if (free[i])
+			free_indices.push_back((unsigned int)i);
+}
+
+// How components are stored in a snapshot, by default as a copy of their bytes
+// Specialize it for components that are only meaningful within one run, e.g., pointers
+template <typename Component>
+struct SnapshotFormat
+{
+	typedef Component Stored;
+	static const Stored& save(const Component& component) { return component; }
+	static const Component& load(const Stored& stored) { return stored; }
+};
+
+// A single block of memory that containers carve their arrays out of, see Registry::reserve()
+// Memory is handed out linearly and only returned as a whole, so containers should reserve their
+// final capacity up front. Once the block is exhausted the allocators fall back to the heap.
+class Arena
+{
+	std::unique_ptr<unsigned char[]> buffer;
+	size_t capacity = 0;
+	size_t used = 0;
+public:
+	// Allocate the block, can only be done once
+	void init(size_t bytes)
+	{
+		assert(!buffer && "Arena already initialized");
+		buffer.reset(new unsigned char[bytes]);
+		capacity = bytes;
+	}
+
+	bool initialized() const { return buffer != nullptr; }
+
+	// Returns nullptr if the arena has no room left
+	void* allocate(size_t bytes, size_t alignment)
+	{
+		size_t base = (size_t)buffer.get();
+		size_t offset = (base + used + alignment - 1) / alignment * alignment - base;
+		if (!buffer || offset + bytes > capacity)
+			return nullptr;
+		used = offset + bytes;
+		return buffer.get() + offset;
+	}
+
+	bool owns(const void* p) const
+	{
+		return p >= buffer.get() && p < buffer.get() + capacity;
+	}
+
+	size_t bytes_used() const { return used; }
+	size_t bytes_reserved() const { return capacity; }
+};
+
+// Allocator for the container arrays, allocates from an Arena if one is bound and from the heap otherwise
+template <typename T>
+struct ArenaAllocator
+{
+	typedef T value_type;
+	// Moving a container moves its arena along
+	typedef std::true_type propagate_on_container_move_assignment;
+
+	Arena* arena = nullptr;
+
+	ArenaAllocator() {}
+	explicit ArenaAllocator(Arena* arena) : arena(arena) {}
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(size_t n)
+	{
+		if (arena != nullptr)
+			if (void* p = arena->allocate(n * sizeof(T), alignof(T)))
+				return static_cast<T*>(p);
+		return static_cast<T*>(::operator new(n * sizeof(T)));
+	}
+
+	void deallocate(T* p, size_t)
+	{
+		if (arena != nullptr && arena->owns(p))
+			return; // returned together with the whole arena
+		::operator delete(p);
+	}
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena == b.arena; }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena != b.arena; }
+
+// Callbacks of the owning group a container belongs to, see OwningGroup
+struct GroupLink
+{
+	void* group = nullptr;
+	void (*inserted)(void* group, Entity e) = nullptr;  // after a component was appended
+	void (*removing)(void* group, Entity e) = nullptr;  // before a single component is removed
+	void (*reordered)(void* group) = nullptr;           // after a bulk change, e.g., clear or restore
+};
+
+// The sparse index of a container is split into pages of this many entity indices.
+// A page is only allocated once an entity index in its range is inserted.
+const unsigned int SPARSE_PAGE_SIZE = 4096;
+
+// Returned by try_index_of() for entities that are not in the container
+const unsigned int NO_SLOT = ~0u;
+
+// How a ComponentContainer lays out its components, by default as one array of structs
+// Specialize it to keep every field of a component in its own array, e.g., for SIMD loops over one field of all
+// components, see MotionArray. Such an array hands out proxy references that read and write the fields in place.
+template <typename Component, typename Allocator>
+struct ComponentStorage
+{
+	typedef std::vector<Component, Allocator> Array;
+	typedef Component& Reference;
+	typedef const Component& ConstReference;
+	// Array::data() points to all components, so snapshots copy them as one block
+	static const bool contiguous = true;
 };
 
 // A container that stores components of type 'Component' and associated entities
-template <typename Component> // A component can be any class
-class ComponentContainer : public ContainerInterface
+// All dense arrays are allocated with 'Allocator', by default from the arena of the registry
+// Change tracking follows one rule: get(), touch(), touch_slot() and patch() stamp the component with the current
+// version. Only touch(), touch_slot() and patch() notify the on_update listeners, as they run after the write.
+// Views, parallel loops and the dense arrays are read-only for tracking, code that writes through them calls
+// touch() or touch_slot() afterwards, on the thread that owns the registry.
+template <typename Component, typename Allocator = ArenaAllocator<Component>> // A component can be any class
+class ComponentContainer final : public ContainerInterface
 {
+	template <typename T>
+	using ArrayOf = std::vector<T, typename std::allocator_traits<Allocator>::template rebind_alloc<T>>;
+	typedef ComponentStorage<Component, Allocator> Storage;
+public:
+	// The array of all components, std::vector unless ComponentStorage is specialized for the type
+	typedef typename Storage::Array Array;
+	// What get() and the loops hand out, Component& unless the array stores the fields separately
+	typedef typename Storage::Reference Reference;
+	typedef typename Storage::ConstReference ConstReference;
 private:
-	// The hash map from Entity -> array index.
-	std::unordered_map<unsigned int, unsigned int> map_entity_componentID; // the entity is cast to uint to be hashable.
+	// The paged sparse index from Entity index -> array index.
+	// Entries are never reset, a lookup is only valid if entities[index] points back to the same entity and generation.
+	std::vector<std::vector<unsigned int>> sparse_pages;
 	bool registered = false;
+
+	// Scratch buffer of sort(), kept between calls so that re-sorting does not allocate
+	std::vector<unsigned int> sort_order;
+
+	// Returns the sparse index entry of an entity, allocating its page on first use
+	unsigned int& sparse_entry(Entity e)
+	{
+		unsigned int id = e.index();
+		unsigned int page = id / SPARSE_PAGE_SIZE;
+		if (page >= sparse_pages.size())
+			sparse_pages.resize(page + 1);
+		if (sparse_pages[page].empty())
+			sparse_pages[page].resize(SPARSE_PAGE_SIZE, 0);
+		return sparse_pages[page][id % SPARSE_PAGE_SIZE];
+	}
+
+	// Views yield the components without marking them as changed
+	template <typename... Components>
+	friend class View;
+
+	// An owning group keeps its members at the front of the container, in the same order in all owned containers
+	template <typename... Owned>
+	friend class OwningGroup;
+	const GroupLink* group = nullptr;
+
+	// The dense array index of an entity or NO_SLOT, so a view probes every container with a single lookup
+	unsigned int try_index_of(Entity e)
+	{
+		ECS_COUNT_ACCESS(has_calls);
+		unsigned int cID = index_of(e);
+		return cID < entities.size() && (unsigned int)entities[cID] == (unsigned int)e ? cID : NO_SLOT;
+	}
+
+	Reference at_slot(unsigned int slot) { return components[slot]; }
+
+	// Exchange two slots of the dense arrays, for the owning group
+	void swap_slots(unsigned int a, unsigned int b)
+	{
+		if (a == b)
+			return;
+		using std::swap;
+		swap(components[a], components[b]); // a proxy reference brings its own swap
+		std::swap(entities[a], entities[b]);
+		std::swap(versions[a], versions[b]);
+		sparse_entry(entities[a]) = a;
+		sparse_entry(entities[b]) = b;
+	}
+
+	void notify_reordered()
+	{
+		if (group != nullptr)
+			group->reordered(group->group);
+	}
+
+	// Before the whole container is emptied
+	void notify_destroy_all()
+	{
+		if (signals)
+			for (unsigned int i = 0; i < entities.size(); i++)
+				notify_destroy(entities[i]);
+	}
+
+	// Components without a SnapshotFormat specialization are copied as one block, unless their fields are split
+	typedef SnapshotFormat<Component> Format;
+	typedef std::integral_constant<bool, std::is_same<typename Format::Stored, Component>::value && Storage::contiguous> StoredAsIs;
+
+	void save_components(Snapshot& snapshot, std::true_type) const
+	{
+		snapshot.write_array(components.data(), components.size());
+	}
+
+	void save_components(Snapshot& snapshot, std::false_type) const
+	{
+		typename Format::Stored* stored = snapshot.append_array<typename Format::Stored>(components.size());
+		for (size_t i = 0; i < components.size(); i++)
+			stored[i] = Format::save(components[i]);
+	}
+
+	void restore_components(Snapshot& snapshot)
+	{
+		size_t count;
+		const typename Format::Stored* stored = snapshot.read_array<typename Format::Stored>(count);
+		restore_components(stored, count, StoredAsIs());
+	}
+
+	void restore_components(const Component* stored, size_t count, std::true_type)
+	{
+		components.assign(stored, stored + count);
+	}
+
+	void restore_components(const typename Format::Stored* stored, size_t count, std::false_type)
+	{
+		components.clear();
+		for (size_t i = 0; i < count; i++)
+			components.push_back(Format::load(stored[i]));
+	}
+
+	// has() without counting the call, for the lookups the container does itself
+	bool holds(Entity entity) const
+	{
+		unsigned int cID = index_of(entity);
+		return cID < entities.size() && (unsigned int)entities[cID] == (unsigned int)entity;
+	}
+
+	// Returns the array index stored for an entity without checking that it is contained
+	unsigned int index_of(Entity e) const
+	{
+		unsigned int id = e.index();
+		unsigned int page = id / SPARSE_PAGE_SIZE;
+		if (page >= sparse_pages.size() || sparse_pages[page].empty())
+			return (unsigned int)entities.size(); // out of range, never valid
+		return sparse_pages[page][id % SPARSE_PAGE_SIZE];
+	}
 public:
 	// Container of all components of type 'Component'
-	std::vector<Component> components;
+	Array components;
 
 	// The corresponding entities
-	std::vector<Entity> entities;
+	ArrayOf<Entity> entities;
+
+	// The version at which each component was last written, see changed_since()
+	ArrayOf<unsigned int> versions;
 
 	// Constructor that registers the type
 	ComponentContainer()
 	{
 	}
 
+	// Switch to another allocator, only possible while the container is empty
+	void set_allocator(const Allocator& allocator)
+	{
+		assert(components.empty() && "Allocator can only be changed on an empty container");
+		components = Array(allocator);
+		entities = ArrayOf<Entity>(allocator);
+		versions = ArrayOf<unsigned int>(allocator);
+	}
+
+	// Capacity hint, inserting up to 'count' components will not reallocate or move existing ones
+	void reserve(size_t count)
+	{
+		components.reserve(count);
+		entities.reserve(count);
+		versions.reserve(count);
+		sort_order.reserve(count);
+	}
+
+	// Number of bytes that reserve(count) takes from the allocator
+	static size_t bytes_to_reserve(size_t count)
+	{
+		return count * (sizeof(Component) + sizeof(Entity) + sizeof(unsigned int)) + alignof(Component) + alignof(Entity) + alignof(unsigned int); // worst case padding
+	}
+
 	// Inserting a component c associated to entity e
-	inline Component& insert(Entity e, Component c, bool check_for_duplicates = true)
+	inline Reference insert(Entity e, Component c, bool check_for_duplicates = true)
 	{
 		// Usually, every entity should only have one instance of each component type
 		assert(!(check_for_duplicates && has(e)) && "Entity already contained in ECS registry");
+		ECS_COUNT_ACCESS(insert_calls);
 
-		map_entity_componentID[e] = (unsigned int)components.size();
+		sparse_entry(e) = (unsigned int)components.size();
 		components.push_back(std::move(c)); // the move enforces move instead of copy constructor
 		entities.push_back(e);
+		versions.push_back(current_version);
+		set_mask_bit(e);
+		if (group != nullptr)
+			group->inserted(group->group, e); // the entity joins the group later, nothing is moved here
+		notify_construct(e);
 		return components.back();
 	};
 
 	// The emplace function takes the the provided arguments Args, creates a new object of type Component, and inserts it into the ECS system
 	template<typename... Args>
-	Component& emplace(Entity e, Args &&... args) {
+	Reference emplace(Entity e, Args &&... args) {
 		return insert(e, Component(std::forward<Args>(args)...));
 	};
 	template<typename... Args>
-	Component& emplace_with_duplicates(Entity e, Args &&... args) {
+	Reference emplace_with_duplicates(Entity e, Args &&... args) {
 		return insert(e, Component(std::forward<Args>(args)...), false);
 	};
 
-	// A wrapper to return the component of an entity
-	Component& get(Entity e) {
+	// Insert a copy of 'value' for each of 'count' entities, the arrays grow at most once
+	void insert_copies(const Entity* batch, size_t count, const Component& value)
+	{
+		append_copies(batch, count, value);
+		notify_appended(batch, count);
+	}
+
+	// insert_copies() without notifying the group and the listeners, returns the slot of the first copy
+	// The caller may write to the copies through appended_at() and calls notify_appended() afterwards,
+	// so that on_construct listeners see the final values, see Registry::spawn_batch()
+	unsigned int append_copies(const Entity* batch, size_t count, const Component& value)
+	{
+		ECS_COUNT_ACCESS(insert_calls);
+#ifndef NDEBUG
+		for (size_t i = 0; i < count; i++)
+			assert(!holds(batch[i]) && "Entity already contained in ECS registry");
+#endif
+		unsigned int first = (unsigned int)components.size();
+		components.insert(components.end(), count, value);
+		entities.insert(entities.end(), batch, batch + count);
+		versions.insert(versions.end(), count, current_version);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			sparse_entry(batch[i]) = first + i;
+			set_mask_bit(batch[i]);
+		}
+		return first;
+	}
+
+	// The i-th copy of an append_copies() call that returned 'first', valid until the group is next accessed
+	Reference appended_at(unsigned int first, size_t i) { return components[first + i]; }
+
+	// Let the owning group and the on_construct listeners know about the entities of an append_copies() call
+	void notify_appended(const Entity* batch, size_t count)
+	{
+		for (unsigned int i = 0; (group != nullptr || signals) && i < count; i++)
+		{
+			if (group != nullptr)
+				group->inserted(group->group, batch[i]);
+			notify_construct(batch[i]);
+		}
+	}
+
+	// A wrapper to return the component of an entity, it is marked as changed since the caller may write to it
+	// The on_update listeners are not notified, the write happens after get() returns. Use patch() to notify them.
+	Reference get(Entity e) {
 		assert(has(e) && "Entity not contained in ECS registry");
-		return components[map_entity_componentID[e]];
+		ECS_COUNT_ACCESS(get_calls);
+		unsigned int cID = index_of(e);
+		versions[cID] = current_version;
+		return components[cID];
+	}
+
+	// Read-only access that does not mark the component as changed
+	ConstReference read(Entity e) {
+		assert(has(e) && "Entity not contained in ECS registry");
+		ECS_COUNT_ACCESS(get_calls);
+		return components[index_of(e)];
+	}
+
+	// Mark a component as changed after writing to it through the components array or a view
+	void touch(Entity e) {
+		assert(has(e) && "Entity not contained in ECS registry");
+		touch_slot(index_of(e));
+	}
+
+	// touch() for the component in slot i of the dense arrays, e.g., after a loop over them
+	void touch_slot(unsigned int i) {
+		versions[i] = current_version;
+		notify_update(entities[i]);
+	}
+
+	// Write to a component through fn(component&), mark it as changed and notify the on_update listeners
+	template <typename Function>
+	Reference patch(Entity e, Function fn) {
+		assert(has(e) && "Entity not contained in ECS registry");
+		unsigned int cID = index_of(e);
+		Reference component = components[cID];
+		fn(component);
+		touch_slot(cID);
+		return component;
+	}
+
+	// Check if the component of an entity was written after the given version, e.g., one saved at an earlier frame
+	bool changed_since(Entity e, unsigned int version) {
+		assert(has(e) && "Entity not contained in ECS registry");
+		return versions[index_of(e)] > version;
+	}
+
+	// Calls fn(entity, component&) for every component written after the given version
+	template <typename Function>
+	void each_changed_since(unsigned int version, Function fn) {
+		for (unsigned int i = 0; i < versions.size(); i++)
+			if (versions[i] > version)
+				fn(entities[i], components[i]);
+	}
+
+	// Calls fn(entity, component&) for every component, splitting the dense arrays into ranges of 'grain' across the worker threads
+	// fn must not add or remove components, and like View::each it does not mark the components as changed,
+	// touch() the written ones after the loop returned
+	template <typename Function>
+	void parallel_for_each(Function fn, size_t grain = PARALLEL_GRAIN) {
+		ThreadPool::shared().parallel_for(components.size(), grain, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				fn(entities[i], components[i]);
+		});
+	}
+
+	// Append the entities and components to a snapshot, the versions are not stored
+	void save(Snapshot& snapshot) const
+	{
+		snapshot.write_array(entities.data(), entities.size());
+		save_components(snapshot, StoredAsIs());
+	}
+
+	// Replace the contents by the next container in a snapshot, the entity masks are restored by the registry
+	// All restored components count as changed
+	void restore(Snapshot& snapshot)
+	{
+		notify_destroy_all();
+		size_t count;
+		const Entity* saved_entities = snapshot.read_array<Entity>(count);
+		entities.clear();
+		for (size_t i = 0; i < count; i++)
+			entities.push_back(Entity::from_index(saved_entities[i].index())); // the handle re-issued by the restore
+		versions.assign(count, current_version);
+		restore_components(snapshot);
+		assert(components.size() == entities.size());
+		for (unsigned int i = 0; i < count; i++)
+			sparse_entry(entities[i]) = i;
+		notify_reordered();
+		if (signals)
+			for (unsigned int i = 0; i < entities.size(); i++)
+				notify_construct(entities[i]);
 	}
 
 	// Check if entity has a component of type 'Component'
 	bool has(Entity entity) {
-		return map_entity_componentID.count(entity) > 0;
+		ECS_COUNT_ACCESS(has_calls);
+		return holds(entity);
 	}
 
 	// Remove an component and pack the container to re-use the empty space
 	void remove(Entity e)
 	{
-		if (has(e))
+		ECS_COUNT_ACCESS(remove_calls);
+		if (holds(e))
 		{
+			notify_destroy(e);
+
+			// A group member is first moved behind the group, so the swap below does not break it up
+			if (group != nullptr)
+				group->removing(group->group, e);
+
 			// Get the current position
-			int cID = map_entity_componentID[e];
+			unsigned int cID = index_of(e);
 
 			// Move the last element to position cID using the move operator
 			// Note, components[cID] = components.back() would trigger the copy instead of move operator
 			components[cID] = std::move(components.back());
 			entities[cID] = entities.back(); // the entity is only a single index, copy it.
-			map_entity_componentID[entities.back()] = cID;
+			versions[cID] = versions.back();
+			sparse_entry(entities.back()) = cID;
 
 			// Erase the old component and free its memory
-			map_entity_componentID.erase(e);
 			components.pop_back();
 			entities.pop_back();
-			// Note, one could mark the id for re-use
+			versions.pop_back();
+			clear_mask_bit(e);
 		}
 	};
 
 	// Remove all components of type 'Component'
+	// The sparse pages are kept, their stale entries fail the has() check
 	void clear()
 	{
-		map_entity_componentID.clear();
+		notify_destroy_all();
+		for (Entity e : entities)
+			clear_mask_bit(e);
+		components.clear();
+		entities.clear();
+		versions.clear();
+		notify_reordered();
+	}
+
+	// Remove the components of all entities whose index is set in the bitset
+	// A single pass that compacts the arrays and keeps the order of the remaining components
+	void remove_marked(const std::vector<uint64_t>& marked)
+	{
+		if (signals)
+			for (unsigned int i = 0; i < entities.size(); i++)
+				if (bit_is_set(marked, entities[i].index()))
+					notify_destroy(entities[i]);
+
+		unsigned int kept = 0;
+		for (unsigned int i = 0; i < entities.size(); i++)
+		{
+			if (bit_is_set(marked, entities[i].index()))
+			{
+				clear_mask_bit(entities[i]);
+				continue;
+			}
+			if (kept != i)
+			{
+				components[kept] = std::move(components[i]);
+				entities[kept] = entities[i];
+				versions[kept] = versions[i];
+				sparse_entry(entities[kept]) = kept;
+			}
+			kept++;
+		}
+		components.erase(components.begin() + kept, components.end());
+		entities.erase(entities.begin() + kept, entities.end());
+		versions.erase(versions.begin() + kept, versions.end());
+		notify_reordered();
+	}
+
+	// Remove all components without updating the entity masks, for the registry when it resets the masks itself
+	// The arrays keep their capacity
+	void reset()
+	{
+		notify_destroy_all();
 		components.clear();
 		entities.clear();
+		versions.clear();
+		notify_reordered();
 	}
 
 	// Report the number of components of type 'Component'
@@ -120,18 +978,834 @@ public:
 		return components.size();
 	}
 
-	// Sort the components and associated entity assignment structures by the comparisonFunction, see std::sort
+	ContainerStats stats() const
+	{
+		ContainerStats stats;
+		stats.name = type_name<Component>();
+		stats.count = components.size();
+		stats.capacity = components.capacity();
+		stats.dense_bytes = components.capacity() * sizeof(Component) + entities.capacity() * sizeof(Entity) + versions.capacity() * sizeof(unsigned int);
+		size_t index_slots = 0;
+		for (const std::vector<unsigned int>& page : sparse_pages)
+			index_slots += page.capacity();
+		stats.index_bytes = sparse_pages.capacity() * sizeof(std::vector<unsigned int>) + index_slots * sizeof(unsigned int);
+		stats.load_factor = index_slots > 0 ? (float)components.size() / index_slots : 0.f;
+		stats.accesses = accesses();
+		return stats;
+	}
+
+	// Sort the components and associated entity assignment structures by the comparisonFunction on entities, see std::sort
+	// The permutation is applied in place by walking its cycles, only moved slots get a new sparse index entry
 	template <class Compare>
 	void sort(Compare comparisonFunction)
 	{
-		// First sort the entity list as desired
-		std::sort(entities.begin(), entities.end(), comparisonFunction);
-		// Now re-arrange the components (Note, creates a new vector, which may be slow! Not sure if in-place could be faster: https://stackoverflow.com/questions/63703637/how-to-efficiently-permute-an-array-in-place-using-stdswap)
-		std::vector<Component> components_new; components_new.reserve(components.size());
-		std::transform(entities.begin(), entities.end(), std::back_inserter(components_new), [&](Entity e) { return std::move(get(e)); }); // note, the get still uses the old hash map (on purpose!)
-		components = std::move(components_new); // note, we use move operations to not create unneccesary copies of objects, but memory is still allocated for the new vector
-		// Fill the new hashmap
-		for (unsigned int i = 0; i < entities.size(); i++)
-			map_entity_componentID[entities[i]] = i;
+		assert(group == nullptr && "Containers owned by a group keep the order of the group");
+		// First find the new order as indices into the current arrays
+		sort_order.resize(entities.size());
+		for (unsigned int i = 0; i < sort_order.size(); i++)
+			sort_order[i] = i;
+		std::sort(sort_order.begin(), sort_order.end(), [&](unsigned int a, unsigned int b) { return comparisonFunction(entities[a], entities[b]); });
+
+		// Slot i receives the element currently at sort_order[i], each cycle is rotated with a single temporary
+		for (unsigned int i = 0; i < sort_order.size(); i++)
+		{
+			if (sort_order[i] == i)
+				continue;
+			Component component = std::move(components[i]);
+			Entity entity = entities[i];
+			unsigned int version = versions[i];
+			unsigned int current = i;
+			while (sort_order[current] != i)
+			{
+				unsigned int next = sort_order[current];
+				components[current] = std::move(components[next]);
+				entities[current] = entities[next];
+				versions[current] = versions[next];
+				sparse_entry(entities[current]) = current;
+				sort_order[current] = current; // mark as placed
+				current = next;
+			}
+			components[current] = std::move(component);
+			entities[current] = entity;
+			versions[current] = version;
+			sparse_entry(entity) = current;
+			sort_order[current] = current;
+		}
+	}
+};
+
+// A container for empty marker components (tags), e.g., Player or SoftShell
+// Membership is a bitset indexed by the entity index, so has() is a bit test plus the generation check of the handle.
+// Like in a ComponentContainer, stale handles are not contained, the bit belongs to the entity currently using the index.
+template <typename Tag>
+class TagContainer final : public ContainerInterface
+{
+	static_assert(std::is_empty<Tag>::value, "Only empty components can be stored as tags");
+public:
+	typedef Tag& Reference;
+private:
+	std::vector<uint64_t> bits;
+	size_t count = 0;
+
+	// All entities share the same instance, a tag holds no data
+	static Tag& instance()
+	{
+		static Tag tag;
+		return tag;
+	}
+
+	template <typename... Components>
+	friend class View;
+
+	// The slot of a tag is its entity index, there is nothing to fetch afterwards
+	unsigned int try_index_of(Entity e)
+	{
+		ECS_COUNT_ACCESS(has_calls);
+		return holds(e) ? e.index() : NO_SLOT;
+	}
+
+	Tag& at_slot(unsigned int) { return instance(); }
+
+	// has() without counting the call, for the lookups the container does itself
+	bool holds(Entity e) const
+	{
+		unsigned int word = e.index() / 64;
+		return word < bits.size() && (bits[word] >> (e.index() % 64) & 1) != 0 && Entity::is_alive(e);
+	}
+public:
+	TagContainer()
+	{
+	}
+
+	// Inserting a tag for entity e
+	Tag& insert(Entity e, Tag = Tag(), bool check_for_duplicates = true)
+	{
+		assert(!(check_for_duplicates && has(e)) && "Entity already contained in ECS registry");
+		ECS_COUNT_ACCESS(insert_calls);
+		unsigned int word = e.index() / 64;
+		if (word >= bits.size())
+			bits.resize(word + 1, 0);
+		bool added = !holds(e);
+		if (added)
+			count++;
+		bits[word] |= uint64_t(1) << (e.index() % 64);
+		set_mask_bit(e);
+		if (added)
+			notify_construct(e);
+		return instance();
+	}
+
+	Tag& emplace(Entity e) { return insert(e); }
+
+	// Tag each of 'count' entities
+	void insert_copies(const Entity* batch, size_t count, const Tag& = Tag())
+	{
+		for (size_t i = 0; i < count; i++)
+			insert(batch[i]);
+	}
+
+	// As in ComponentContainer, tag the entities now and notify the listeners in notify_appended()
+	unsigned int append_copies(const Entity* batch, size_t count, const Tag& = Tag())
+	{
+		ECS_COUNT_ACCESS(insert_calls);
+		for (size_t i = 0; i < count; i++)
+		{
+			assert(!holds(batch[i]) && "Entity already contained in ECS registry");
+			unsigned int word = batch[i].index() / 64;
+			if (word >= bits.size())
+				bits.resize(word + 1, 0);
+			bits[word] |= uint64_t(1) << (batch[i].index() % 64);
+			set_mask_bit(batch[i]);
+		}
+		this->count += count;
+		return 0;
+	}
+
+	Tag& appended_at(unsigned int, size_t) { return instance(); }
+
+	void notify_appended(const Entity* batch, size_t count)
+	{
+		for (size_t i = 0; signals && i < count; i++)
+			notify_construct(batch[i]);
+	}
+
+	// Capacity hint, make room for the bits of all entity indices below 'count'
+	void reserve(size_t count)
+	{
+		if (bits.size() < (count + 63) / 64)
+			bits.resize((count + 63) / 64, 0);
+	}
+
+	// The bits are allocated from the heap, tags take nothing from an arena
+	static size_t bytes_to_reserve(size_t)
+	{
+		return 0;
+	}
+
+	Tag& get(Entity e)
+	{
+		assert(has(e) && "Entity not contained in ECS registry");
+		ECS_COUNT_ACCESS(get_calls);
+		return instance();
+	}
+
+	// Check if entity has the tag
+	bool has(Entity e)
+	{
+		ECS_COUNT_ACCESS(has_calls);
+		return holds(e);
+	}
+
+	void remove(Entity e)
+	{
+		ECS_COUNT_ACCESS(remove_calls);
+		if (holds(e))
+		{
+			notify_destroy(e);
+			bits[e.index() / 64] &= ~(uint64_t(1) << (e.index() % 64));
+			count--;
+			clear_mask_bit(e);
+		}
+	}
+
+	// Remove all tags, the bitset keeps its size
+	void clear()
+	{
+		if (signals)
+			each([this](Entity e) { notify_destroy(e); });
+		if (entity_masks != nullptr)
+			each([this](Entity e) { clear_mask_bit(e); });
+		std::fill(bits.begin(), bits.end(), 0);
+		count = 0;
+	}
+
+	// Remove the tag of all entities whose index is set in the bitset, one word at a time
+	void remove_marked(const std::vector<uint64_t>& marked)
+	{
+		for (unsigned int w = 0; w < bits.size() && w < marked.size(); w++)
+		{
+			uint64_t removed = bits[w] & marked[w];
+			for (uint64_t word = removed; signals && word != 0; word &= word - 1)
+				notify_destroy(Entity::from_index(w * 64 + lowest_bit_index(word)));
+			count -= bit_count(removed);
+			bits[w] &= ~removed;
+			for (; entity_masks != nullptr && removed != 0; removed &= removed - 1)
+				clear_mask_bit(Entity::from_index(w * 64 + lowest_bit_index(removed)));
+		}
+	}
+
+	// Append the bitset to a snapshot
+	void save(Snapshot& snapshot) const
+	{
+		snapshot.write_array(bits.data(), bits.size());
+		snapshot.write_value((uint64_t)count);
+	}
+
+	// Replace the bitset by the next tag container in a snapshot, the entity masks are restored by the registry
+	void restore(Snapshot& snapshot)
+	{
+		if (signals)
+			each([this](Entity e) { notify_destroy(e); });
+		size_t words;
+		const uint64_t* saved = snapshot.read_array<uint64_t>(words);
+		bits.assign(saved, saved + words);
+		count = (size_t)snapshot.read_value<uint64_t>();
+		if (signals)
+			each([this](Entity e) { notify_construct(e); });
+	}
+
+	// Remove all tags without updating the entity masks, for the registry when it resets the masks itself
+	void reset()
+	{
+		if (signals)
+			each([this](Entity e) { notify_destroy(e); });
+		std::fill(bits.begin(), bits.end(), 0);
+		count = 0;
+	}
+
+	// Report the number of tagged entities
+	size_t size()
+	{
+		return count;
+	}
+
+	ContainerStats stats() const
+	{
+		ContainerStats stats;
+		stats.name = type_name<Tag>();
+		stats.count = count;
+		stats.capacity = bits.size() * 64;
+		stats.index_bytes = bits.capacity() * sizeof(uint64_t);
+		stats.load_factor = bits.empty() ? 0.f : (float)count / (bits.size() * 64);
+		stats.accesses = accesses();
+		return stats;
+	}
+
+	// Calls fn(entity) for every tagged entity in order of the entity index, one bitset word at a time
+	// fn may remove the visited entity
+	template <typename Function>
+	void each(Function fn)
+	{
+		for (unsigned int w = 0; w < bits.size(); w++)
+		{
+			uint64_t word = bits[w];
+			while (word != 0)
+			{
+				fn(Entity::from_index(w * 64 + lowest_bit_index(word)));
+				word &= word - 1; // clear the lowest set bit
+			}
+		}
+	}
+};
+
+// Empty marker components are stored as tags, all others in a ComponentContainer
+template <typename Component>
+using ContainerOf = typename std::conditional<std::is_empty<Component>::value,
+	TagContainer<Component>, ComponentContainer<Component>>::type;
+
+// A view over all entities that have every one of the given components
+// Iteration is driven by the smallest container, the others are only probed through their sparse index or bitset
+template <typename... Components>
+class View
+{
+	std::tuple<ContainerOf<Components>*...> containers;
+	// Position of the smallest container in the list of components
+	unsigned int driver = 0;
+
+	// Walk all entities of the driving container
+	template <typename Component, typename Allocator, typename Function>
+	static void each_entity_of(ComponentContainer<Component, Allocator>* container, Function fn)
+	{
+		for (unsigned int i = 0; i < container->entities.size(); i++)
+			fn(container->entities[i]);
+	}
+
+	template <typename Component, typename Function>
+	static void each_entity_of(TagContainer<Component>* container, Function fn)
+	{
+		container->each(fn);
+	}
+
+	// Split the entities of the driving container into ranges for the worker threads
+	template <typename Component, typename Allocator, typename Function>
+	static void parallel_each_entity_of(ComponentContainer<Component, Allocator>* container, Function fn, size_t grain)
+	{
+		ThreadPool::shared().parallel_for(container->entities.size(), grain, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				fn(container->entities[i]);
+		});
+	}
+
+	// Tags are split by bitset words, so that a range covers about 'grain' entity indices
+	template <typename Component, typename Function>
+	static void parallel_each_entity_of(TagContainer<Component>* container, Function fn, size_t grain)
+	{
+		ThreadPool::shared().parallel_for(container->bits.size(), (grain + 63) / 64, [&](size_t begin, size_t end)
+		{
+			for (size_t w = begin; w < end; w++)
+			{
+				uint64_t word = container->bits[w];
+				while (word != 0)
+				{
+					fn(Entity::from_index((unsigned int)w * 64 + lowest_bit_index(word)));
+					word &= word - 1;
+				}
+			}
+		});
+	}
+
+	// Probe each container once and pass the components at the found slots, stops at the first missing one
+	template <typename Function, size_t... I>
+	void visit_entity(Entity e, Function& fn, std::index_sequence<I...>)
+	{
+		unsigned int slots[sizeof...(I)] = {};
+		bool found = true;
+		using expand = int[];
+		(void)expand{ 0, (found = found && (slots[I] = std::get<I>(containers)->try_index_of(e)) != NO_SLOT, 0)... };
+		if (found)
+			fn(e, std::get<I>(containers)->at_slot(slots[I])...);
+	}
+public:
+	View(ContainerOf<Components>&... container_refs)
+		: containers(&container_refs...)
+	{
+		size_t smallest = (size_t)-1;
+		unsigned int i = 0;
+		using expand = int[];
+		(void)expand{ 0, ((container_refs.size() < smallest) ? (smallest = container_refs.size(), driver = i++, 0) : (i++, 0))... };
+	}
+
+	// Check if entity has all components of the view
+	bool contains(Entity e)
+	{
+		bool result = true;
+		using expand = int[];
+		(void)expand{ 0, (result = result && std::get<ContainerOf<Components>*>(containers)->has(e), 0)... };
+		return result;
+	}
+
+	// A wrapper to return one of the components of an entity in the view
+	template <typename Component>
+	typename ContainerOf<Component>::Reference get(Entity e)
+	{
+		return std::get<ContainerOf<Component>*>(containers)->get(e);
+	}
+
+	// Calls fn(entity, components&...) for every entity that has all components
+	// Views are read-only for change tracking, use touch() on the container after writing through them
+	template <typename Function>
+	void each(Function fn)
+	{
+		auto visit = [&](Entity e) { visit_entity(e, fn, std::index_sequence_for<Components...>()); };
+		unsigned int i = 0;
+		using expand = int[];
+		(void)expand{ 0, (i++ == driver ? (each_entity_of(std::get<ContainerOf<Components>*>(containers), visit), 0) : 0)... };
+	}
+
+	// Same as each(), with the entities of the driving container split into ranges across the worker threads
+	// fn may only write to the components it is passed, structural changes have to wait until the loop returned
+	template <typename Function>
+	void parallel_each(Function fn, size_t grain = PARALLEL_GRAIN)
+	{
+		auto visit = [&](Entity e) { visit_entity(e, fn, std::index_sequence_for<Components...>()); };
+		unsigned int i = 0;
+		using expand = int[];
+		(void)expand{ 0, (i++ == driver ? (parallel_each_entity_of(std::get<ContainerOf<Components>*>(containers), visit, grain), 0) : 0)... };
+	}
+};
+
+// A group that owns the containers of its component types, e.g., OwningGroup<Motion, RenderRequest>
+// Every entity that has all of them is kept at the same dense index in [0, size()) of each container,
+// so iterating the group walks the component arrays side by side without any sparse index lookups.
+// Inserting into an owned container only appends, so references returned by earlier inserts stay valid.
+// The entities that got their last missing component join the group at its next access (size(), each(), ...),
+// which swaps components within the containers, as does removing a member. References taken before are invalidated.
+// A container can only be owned by one group and cannot be sorted while it is owned.
+template <typename... Owned>
+class OwningGroup
+{
+	static_assert(sizeof...(Owned) >= 2, "A group owns at least two component types");
+
+	typedef typename std::tuple_element<0, std::tuple<Owned...>>::type First;
+
+	std::tuple<ComponentContainer<Owned>*...> containers;
+	GroupLink link;
+	unsigned int count = 0;
+	// Entities that got one of the owned components since the last access, see sync()
+	std::vector<Entity> pending;
+
+	template <typename Component>
+	ComponentContainer<Component>& owned() { return *std::get<ComponentContainer<Component>*>(containers); }
+
+	bool has_all(Entity e)
+	{
+		bool result = true;
+		using expand = int[];
+		(void)expand{ 0, (result = result && owned<Owned>().holds(e), 0)... };
+		return result;
+	}
+
+	bool is_member(Entity e)
+	{
+		return owned<First>().holds(e) && owned<First>().index_of(e) < count;
+	}
+
+	// Move an entity that got the last missing component to the end of the group
+	void join(Entity e)
+	{
+		if (!has_all(e) || owned<First>().index_of(e) < count)
+			return;
+		using expand = int[];
+		(void)expand{ 0, (owned<Owned>().swap_slots(owned<Owned>().index_of(e), count), 0)... };
+		count++;
+	}
+
+	// Move a member behind the group, e.g., before one of its components is removed
+	// A pending entity is not a member yet and stays where it is
+	void leave(Entity e)
+	{
+		if (!is_member(e))
+			return;
+		count--;
+		using expand = int[];
+		(void)expand{ 0, (owned<Owned>().swap_slots(owned<Owned>().index_of(e), count), 0)... };
+	}
+
+	// Rebuild the group after a bulk change of one of the containers
+	// The slots before 'count' hold exactly the members placed so far, so every join swaps with a non-member
+	void refresh()
+	{
+		pending.clear();
+		count = 0;
+		ComponentContainer<First>& driver = owned<First>();
+		for (unsigned int i = 0; i < driver.entities.size(); i++)
+			join(driver.entities[i]);
+	}
+
+	// Join the pending entities, the removed ones and those still missing a component are skipped
+	void sync()
+	{
+		for (Entity e : pending)
+			join(e);
+		pending.clear();
+	}
+
+	static void on_inserted(void* group, Entity e) { static_cast<OwningGroup*>(group)->pending.push_back(e); }
+	static void on_removing(void* group, Entity e) { static_cast<OwningGroup*>(group)->leave(e); }
+	static void on_reordered(void* group) { static_cast<OwningGroup*>(group)->refresh(); }
+
+public:
+	OwningGroup(ComponentContainer<Owned>&... owned_containers)
+		: containers(&owned_containers...)
+	{
+		link.group = this;
+		link.inserted = &on_inserted;
+		link.removing = &on_removing;
+		link.reordered = &on_reordered;
+		using expand = int[];
+		(void)expand{ 0, (assert(owned<Owned>().group == nullptr && "Container already owned by a group"), owned<Owned>().group = &link, 0)... };
+		refresh();
+	}
+
+	~OwningGroup()
+	{
+		using expand = int[];
+		(void)expand{ 0, (owned<Owned>().group = nullptr, 0)... };
+	}
+
+	// The containers point back to this group
+	OwningGroup(const OwningGroup&) = delete;
+	OwningGroup& operator=(const OwningGroup&) = delete;
+
+	// Number of entities that have all owned components
+	size_t size()
+	{
+		sync();
+		return count;
+	}
+
+	bool contains(Entity e)
+	{
+		sync();
+		return is_member(e);
+	}
+
+	// The entity of every group slot
+	const Entity* entities()
+	{
+		sync();
+		return owned<First>().entities.data();
+	}
+
+	// The components of every group slot, element i of each array belongs to entities()[i]
+	template <typename Component>
+	typename ComponentContainer<Component>::Array& components()
+	{
+		sync();
+		return owned<Component>().components;
+	}
+
+	// Calls fn(entity, components&...) for every member in order of the group slots
+	// Like View::each, the components are not marked as changed
+	template <typename Function>
+	void each(Function fn)
+	{
+		sync();
+		for (unsigned int i = 0; i < count; i++)
+			fn(owned<First>().entities[i], owned<Owned>().components[i]...);
+	}
+};
+
+// A bundle of component values that new entities start as a copy of, see Registry::spawn() and Registry::spawn_batch()
+// e.g., Prefab<Motion, SoftShell>(motion, SoftShell())
+template <typename... Components>
+struct Prefab
+{
+	std::tuple<Components...> components;
+
+	Prefab(Components... values) : components(std::move(values)...) {}
+	// Default values, e.g., for a member that is set up once the resources are loaded
+	Prefab() {}
+
+	template <typename Component>
+	Component& get() { return std::get<Component>(components); }
+	template <typename Component>
+	const Component& get() const { return std::get<Component>(components); }
+};
+
+// Registry of one container per component type, the component types are fixed at compile time
+// Every entity carries a mask of the containers it is in, so removing it only touches those
+template <typename... Components>
+class Registry
+{
+	static_assert(sizeof...(Components) <= 64, "A ComponentMask has one bit per component type");
+
+	// The memory block of all component arrays, declared first so that it outlives the containers
+	Arena arena;
+
+	std::tuple<ContainerOf<Components>...> containers;
+
+	// Which containers every entity is in, indexed by entity index
+	std::vector<ComponentMask> entity_masks;
+
+	// Scratch bitset of entity indices for bulk removal, kept to re-use its capacity
+	std::vector<uint64_t> marked;
+
+	// The entities of the last spawn_batch() call
+	std::vector<Entity> spawned;
+
+	// Bind the arrays of a container to the arena
+	template <typename Component>
+	void bind_arena(ComponentContainer<Component>& container) { container.set_allocator(ArenaAllocator<Component>(&arena)); }
+	template <typename Component>
+	void bind_arena(TagContainer<Component>&) {}
+
+	// Position of a component type in the type list
+	template <typename Component, typename First, typename... Rest>
+	struct IndexOf : std::integral_constant<unsigned int, 1 + IndexOf<Component, Rest...>::value> {};
+	template <typename Component, typename... Rest>
+	struct IndexOf<Component, Component, Rest...> : std::integral_constant<unsigned int, 0> {};
+
+public:
+	Registry()
+	{
+		unsigned int bit = 0;
+		using expand = int[];
+		(void)expand{ 0, (container<Components>().attach_masks(&entity_masks, ComponentMask(1) << bit++), 0)... };
+		(void)expand{ 0, (bind_arena(container<Components>()), 0)... };
+	}
+
+	// The containers refer to the masks of this registry
+	Registry(const Registry&) = delete;
+	Registry& operator=(const Registry&) = delete;
+
+	// Returns the container that stores components of type 'Component'
+	template <typename Component>
+	ContainerOf<Component>& container() { return std::get<ContainerOf<Component>>(containers); }
+
+	// Query all entities that have every one of the given components, e.g., registry.view<Motion, SoftShell>()
+	template <typename... ViewComponents>
+	View<ViewComponents...> view() { return View<ViewComponents...>(container<ViewComponents>()...); }
+
+	// Capacity hint for the maximum number of entities alive at the same time
+	// The first call allocates the arena with room for 'count' components of every type, so that the containers
+	// are carved out of a single allocation, and moves the existing components into it.
+	// Afterwards, frames with at most 'count' entities do not allocate.
+	void reserve(size_t count) {
+		using expand = int[];
+		if (!arena.initialized())
+		{
+			size_t bytes = 0;
+			(void)expand{ 0, (bytes += ContainerOf<Components>::bytes_to_reserve(count), 0)... };
+			arena.init(bytes);
+		}
+		(void)expand{ 0, (container<Components>().reserve(count), 0)... };
+		entity_masks.reserve(count + 1);
+		Entity::reserve(count);
+	}
+
+	const Arena& memory() const { return arena; }
+
+	// Copy all containers, entity masks and entity handles into the snapshot, replacing its previous contents
+	// Trivially copyable components are copied with one memcpy per container.
+	void save(Snapshot& snapshot) {
+		snapshot.clear();
+		snapshot.write_value(SNAPSHOT_SIGNATURE);
+		snapshot.write_value((uint32_t)sizeof...(Components));
+		Entity::save_handles(snapshot);
+		snapshot.write_array(entity_masks.data(), entity_masks.size());
+		using expand = int[];
+		(void)expand{ 0, (container<Components>().save(snapshot), 0)... };
+	}
+
+	// Replace the whole state by a snapshot taken from a registry with the same component types
+	// The entities of the snapshot get new handles, see Entity::restore_handles(). Every handle from before the
+	// restore is stale afterwards, use Entity::restored() to look up an entity by its handle at the time of the save.
+	void restore(Snapshot& snapshot) {
+		snapshot.rewind();
+		uint32_t signature = snapshot.read_value<uint32_t>();
+		uint32_t component_count = snapshot.read_value<uint32_t>();
+		assert(signature == SNAPSHOT_SIGNATURE && component_count == sizeof...(Components) && "Not a snapshot of this registry");
+		(void)signature; (void)component_count;
+		using expand = int[];
+		// Empty the containers first, so that on_destroy listeners still see the current handles
+		(void)expand{ 0, (container<Components>().reset(), 0)... };
+		Entity::restore_handles(snapshot);
+		size_t count;
+		const ComponentMask* saved_masks = snapshot.read_array<ComponentMask>(count);
+		entity_masks.assign(saved_masks, saved_masks + count);
+		(void)expand{ 0, (container<Components>().restore(snapshot), 0)... };
+	}
+
+	// Create an entity with a copy of every component of the prefab
+	template <typename... PrefabComponents>
+	Entity spawn(const Prefab<PrefabComponents...>& prefab) {
+		Entity e;
+		using expand = int[];
+		(void)expand{ 0, (container<PrefabComponents>().insert(e, prefab.template get<PrefabComponents>()), 0)... };
+		return e;
+	}
+
+	// Create 'count' entities from a prefab, every container appends all its copies as one block
+	// Afterwards init(i, entity, components&...) is called for the i-th entity, e.g., to set its position.
+	// init() writes to the new slots directly, the on_construct listeners are notified once it is done for all.
+	// Returns the new entities, the list is valid until the next call.
+	template <typename... PrefabComponents, typename Init>
+	const std::vector<Entity>& spawn_batch(const Prefab<PrefabComponents...>& prefab, size_t count, Init init) {
+		spawned.clear();
+		if (count == 0)
+			return spawned;
+		spawned.reserve(count);
+		for (size_t i = 0; i < count; i++)
+			spawned.push_back(Entity());
+		const unsigned int first[] = { container<PrefabComponents>().append_copies(spawned.data(), count, prefab.template get<PrefabComponents>())... };
+		for (size_t i = 0; i < count; i++)
+			init(i, spawned[i], container<PrefabComponents>().appended_at(first[IndexOf<PrefabComponents, PrefabComponents...>::value], i)...);
+		using expand = int[];
+		(void)expand{ 0, (container<PrefabComponents>().notify_appended(spawned.data(), count), 0)... };
+		return spawned;
+	}
+
+	// The bit of a component type in the entity masks
+	template <typename Component>
+	static ComponentMask mask_bit()
+	{
+		return ComponentMask(1) << IndexOf<Component, Components...>::value;
+	}
+
+	// The containers an entity is in, one bit per component type in the order of the type list
+	ComponentMask mask_of(Entity e)
+	{
+		return e.index() < entity_masks.size() ? entity_masks[e.index()] : 0;
+	}
+
+	// Called once at the start of every frame, components written from now on are stamped with a new version
+	// Returns the version of the previous frame, e.g., to query what changed since then
+	unsigned int begin_frame() {
+		using expand = int[];
+		(void)expand{ 0, (container<Components>().end_frame_accesses(), 0)... };
+		return ContainerInterface::current_version++;
+	}
+
+	// Memory and access statistics of every container, in the order of the type list
+	std::vector<ContainerStats> stats() {
+		std::vector<ContainerStats> result;
+		using expand = int[];
+		(void)expand{ 0, (result.push_back(container<Components>().stats()), 0)... };
+		return result;
+	}
+
+	// Write the statistics of all containers and the arena as a JSON object
+	void write_stats_json(FILE* out) {
+#ifdef SALMON_ECS_STATS
+		const char* counting = "true";
+#else
+		const char* counting = "false";
+#endif
+		fprintf(out, "{\n  \"frame\": %u,\n  \"access_counts\": %s,\n", ContainerInterface::current_version, counting);
+		fprintf(out, "  \"arena\": { \"bytes_reserved\": %zu, \"bytes_used\": %zu },\n", arena.bytes_reserved(), arena.bytes_used());
+		fprintf(out, "  \"containers\": [");
+		std::vector<ContainerStats> all = stats();
+		for (size_t i = 0; i < all.size(); i++)
+		{
+			const ContainerStats& c = all[i];
+			std::string name;
+			for (char ch : c.name)
+			{
+				if (ch == '"' || ch == '\\')
+					name += '\\';
+				name += ch;
+			}
+			fprintf(out, "%s\n    { \"type\": \"%s\", \"count\": %zu, \"capacity\": %zu, \"dense_bytes\": %zu, \"index_bytes\": %zu, \"load_factor\": %.4f, "
+				"\"get\": %u, \"has\": %u, \"insert\": %u, \"remove\": %u }",
+				i == 0 ? "" : ",", name.c_str(), c.count, c.capacity, c.dense_bytes, c.index_bytes, c.load_factor,
+				c.accesses.get, c.accesses.has, c.accesses.insert, c.accesses.remove);
+		}
+		fprintf(out, "\n  ]\n}\n");
+	}
+
+	void clear_all_components() {
+		using expand = int[];
+		(void)expand{ 0, (container<Components>().clear(), 0)... };
+	}
+
+	void list_all_components() {
+		printf("Debug info on all registry entries:\n");
+		using expand = int[];
+		(void)expand{ 0, (container<Components>().size() > 0
+			? printf("%4d components of type %s\n", (int)container<Components>().size(), typeid(ContainerOf<Components>).name())
+			: 0)... };
+	}
+
+	void list_all_components_of(Entity e) {
+		printf("Debug info on components of entity %u:\n", (unsigned int)e);
+		ComponentMask mask = mask_of(e);
+		unsigned int bit = 0;
+		using expand = int[];
+		(void)expand{ 0, (((mask >> bit++) & 1) ? printf("type %s\n", typeid(ContainerOf<Components>).name()) : 0)... };
+	}
+
+	// Removes the entity from every container it is in and releases its handle, the index may be re-used afterwards
+	void remove_all_components_of(Entity e) {
+		if (!Entity::is_alive(e))
+			return; // stale handle, the mask belongs to the entity that now uses the index
+		ComponentMask mask = mask_of(e);
+		unsigned int bit = 0;
+		using expand = int[];
+		(void)expand{ 0, (((mask >> bit++) & 1) ? (container<Components>().remove(e), 0) : 0)... };
+		Entity::release(e);
+	}
+
+	// Remove all given entities from every container they are in and release their handles
+	// Every affected container is compacted in a single pass instead of one swap-and-pop per entity
+	// The list may be the entity array of one of the containers.
+	template <typename EntityList>
+	void remove_all_components_of(const EntityList& doomed) {
+		ComponentMask affected = 0;
+		for (Entity e : doomed)
+		{
+			if (!Entity::is_alive(e))
+				continue;
+			unsigned int index = e.index();
+			if (index / 64 >= marked.size())
+				marked.resize(index / 64 + 1, 0);
+			marked[index / 64] |= uint64_t(1) << (index % 64);
+			affected |= mask_of(e);
+		}
+		using expand = int[];
+		(void)expand{ 0, ((affected & mask_bit<Components>()) ? (container<Components>().remove_marked(marked), 0) : 0)... };
+
+		// Release the handles last, the list may have been compacted above
+		for (unsigned int w = 0; w < marked.size(); w++)
+		{
+			for (uint64_t word = marked[w]; word != 0; word &= word - 1)
+				Entity::release(Entity::from_index(w * 64 + lowest_bit_index(word)));
+			marked[w] = 0;
+		}
+	}
+
+	// Remove every entity that has none of the 'Kept' components and release its handle, e.g., to keep singletons
+	// Entities with a kept component only keep those. The other containers are cleared at once and keep their
+	// capacity, the only per-entity work is a single pass over the entity masks to release the handles.
+	template <typename... Kept>
+	void remove_all_entities_except() {
+		ComponentMask keep = 0;
+		using expand = int[];
+		(void)expand{ 0, (keep |= mask_bit<Kept>(), 0)... };
+		// Clear before releasing, so that on_destroy listeners still see the current handles
+		(void)expand{ 0, ((keep & mask_bit<Components>()) ? 0 : (container<Components>().reset(), 0))... };
+		for (unsigned int i = 0; i < entity_masks.size(); i++)
+		{
+			if (entity_masks[i] == 0)
+				continue;
+			if (entity_masks[i] & keep)
+				entity_masks[i] &= keep;
+			else
+			{
+				Entity::release(Entity::from_index(i));
+				entity_masks[i] = 0;
+			}
+		}
 	}
 };
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "tiny_ecs.hpp"
+
+// Alternative ECS storage that groups entities by their set of component types (archetype).
+// Every archetype stores its entities in fixed-size chunks, each component type is a contiguous
+// array inside a chunk. Iterating entities that share a signature is then a linear walk.
+// Only trivially copyable components are supported since rows are moved with memcpy.
+
+// Size of the component data of a single chunk
+const size_t ARCHETYPE_CHUNK_BYTES = 16 * 1024;
+
+// Maximum number of component types that archetype signatures can distinguish
+const unsigned int ARCHETYPE_MAX_COMPONENTS = 64;
+
+// One bit per component type, identifies an archetype
+typedef uint64_t ComponentSignature;
+
+// Every component type stored in archetypes gets a small id, in order of first use
+inline unsigned int next_archetype_component_id()
+{
+	static unsigned int count = 0;
+	assert(count < ARCHETYPE_MAX_COMPONENTS && "Too many component types for archetype signatures");
+	return count++;
+}
+
+template <typename Component>
+unsigned int archetype_component_id()
+{
+	static unsigned int id = next_archetype_component_id();
+	return id;
+}
+
+template <typename Component>
+ComponentSignature archetype_signature_bit()
+{
+	return ComponentSignature(1) << archetype_component_id<Component>();
+}
+
+// Layout of one component array inside the chunks of an archetype
+struct ArchetypeColumn
+{
+	unsigned int component_id = 0;
+	size_t size = 0; // 0 for empty marker components, they only contribute to the signature
+	size_t alignment = 1;
+	size_t offset = 0; // byte offset of the array inside every chunk
+};
+
+// A fixed-size block holding up to 'capacity' entities of one archetype
+struct ArchetypeChunk
+{
+	unsigned char data[ARCHETYPE_CHUNK_BYTES]; // allocated with new, aligned for any fundamental type
+	std::vector<Entity> entities; // the entity of every row
+};
+
+// All entities with exactly the same set of components
+struct Archetype
+{
+	ComponentSignature signature = 0;
+	std::vector<ArchetypeColumn> columns;
+	std::array<int, ARCHETYPE_MAX_COMPONENTS> column_of; // component id -> index into columns, -1 if absent
+	unsigned int capacity = 0; // entities per chunk
+	std::vector<std::unique_ptr<ArchetypeChunk>> chunks; // only the last chunk may be partially filled
+
+	unsigned char* column_data(unsigned int chunk, const ArchetypeColumn& column)
+	{
+		return chunks[chunk]->data + column.offset;
+	}
+};
+
+class ArchetypeStorage
+{
+	// Where the components of an entity live, indexed by the entity index
+	struct EntityLocation
+	{
+		Archetype* archetype = nullptr;
+		unsigned int chunk = 0;
+		unsigned int row = 0;
+	};
+	std::vector<EntityLocation> locations;
+
+	std::unordered_map<ComponentSignature, std::unique_ptr<Archetype>> archetypes;
+
+	// Size and alignment of every component type seen so far
+	std::array<ArchetypeColumn, ARCHETYPE_MAX_COMPONENTS> known_components;
+
+	template <typename Component>
+	unsigned int register_component()
+	{
+		static_assert(std::is_trivially_copyable<Component>::value, "Archetype storage moves components with memcpy");
+		unsigned int id = archetype_component_id<Component>();
+		ArchetypeColumn& column = known_components[id];
+		column.component_id = id;
+		column.size = std::is_empty<Component>::value ? 0 : sizeof(Component);
+		column.alignment = alignof(Component);
+		return id;
+	}
+
+	Archetype& find_or_create_archetype(ComponentSignature signature)
+	{
+		std::unique_ptr<Archetype>& archetype = archetypes[signature];
+		if (archetype)
+			return *archetype;
+
+		archetype.reset(new Archetype());
+		archetype->signature = signature;
+		archetype->column_of.fill(-1);
+		size_t bytes_per_entity = 0;
+		size_t padding = 0;
+		for (unsigned int id = 0; id < ARCHETYPE_MAX_COMPONENTS; id++)
+		{
+			if (!(signature & (ComponentSignature(1) << id)))
+				continue;
+			archetype->column_of[id] = (int)archetype->columns.size();
+			archetype->columns.push_back(known_components[id]);
+			bytes_per_entity += known_components[id].size;
+			padding += known_components[id].alignment - 1;
+		}
+		archetype->capacity = bytes_per_entity == 0
+			? (unsigned int)(ARCHETYPE_CHUNK_BYTES / sizeof(Entity))
+			: (unsigned int)((ARCHETYPE_CHUNK_BYTES - padding) / bytes_per_entity);
+		assert(archetype->capacity > 0 && "Component bundle does not fit into a single chunk");
+
+		// Lay out the columns one after the other, each aligned for its type
+		size_t offset = 0;
+		for (ArchetypeColumn& column : archetype->columns)
+		{
+			offset = (offset + column.alignment - 1) / column.alignment * column.alignment;
+			column.offset = offset;
+			offset += column.size * archetype->capacity;
+		}
+		assert(offset <= ARCHETYPE_CHUNK_BYTES);
+		return *archetype;
+	}
+
+	// Appends a row for the entity, the component data of the row is uninitialized
+	EntityLocation allocate_row(Archetype& archetype, Entity e)
+	{
+		if (archetype.chunks.empty() || archetype.chunks.back()->entities.size() == archetype.capacity)
+		{
+			archetype.chunks.emplace_back(new ArchetypeChunk); // default-initialized, the data is written row by row
+			archetype.chunks.back()->entities.reserve(archetype.capacity);
+		}
+		EntityLocation location;
+		location.archetype = &archetype;
+		location.chunk = (unsigned int)archetype.chunks.size() - 1;
+		location.row = (unsigned int)archetype.chunks.back()->entities.size();
+		archetype.chunks.back()->entities.push_back(e);
+		if (e.index() >= locations.size())
+			locations.resize(e.index() + 1);
+		locations[e.index()] = location;
+		return location;
+	}
+
+	// Fill the row with the last row of the archetype to keep the chunks dense
+	void free_row(const EntityLocation& location)
+	{
+		Archetype& archetype = *location.archetype;
+		unsigned int last_chunk = (unsigned int)archetype.chunks.size() - 1;
+		ArchetypeChunk& last = *archetype.chunks[last_chunk];
+		unsigned int last_row = (unsigned int)last.entities.size() - 1;
+		if (location.chunk != last_chunk || location.row != last_row)
+		{
+			for (const ArchetypeColumn& column : archetype.columns)
+				std::memcpy(archetype.column_data(location.chunk, column) + location.row * column.size,
+					archetype.column_data(last_chunk, column) + last_row * column.size, column.size);
+			Entity moved = last.entities[last_row];
+			archetype.chunks[location.chunk]->entities[location.row] = moved;
+			locations[moved.index()].chunk = location.chunk;
+			locations[moved.index()].row = location.row;
+		}
+		last.entities.pop_back();
+		if (last.entities.empty())
+			archetype.chunks.pop_back();
+	}
+
+	// Moves an entity into the archetype with the given signature, copying all shared components
+	EntityLocation move_entity(Entity e, ComponentSignature signature)
+	{
+		EntityLocation source = location_of(e);
+		if (source.archetype != nullptr && source.archetype->signature == signature)
+			return source;
+		if (signature == 0)
+		{
+			// An entity without components is not stored
+			if (source.archetype != nullptr)
+				free_row(source);
+			if (e.index() < locations.size())
+				locations[e.index()] = EntityLocation();
+			return EntityLocation();
+		}
+		Archetype& target_archetype = find_or_create_archetype(signature);
+		EntityLocation target = allocate_row(target_archetype, e);
+		if (source.archetype != nullptr)
+		{
+			for (const ArchetypeColumn& column : target_archetype.columns)
+			{
+				int source_column = source.archetype->column_of[column.component_id];
+				if (source_column < 0)
+					continue;
+				const ArchetypeColumn& from = source.archetype->columns[source_column];
+				std::memcpy(target_archetype.column_data(target.chunk, column) + target.row * column.size,
+					source.archetype->column_data(source.chunk, from) + source.row * from.size, column.size);
+			}
+			free_row(source);
+		}
+		return target;
+	}
+
+	EntityLocation location_of(Entity e)
+	{
+		if (e.index() >= locations.size())
+			return EntityLocation();
+		EntityLocation location = locations[e.index()];
+		if (location.archetype == nullptr ||
+			(unsigned int)location.archetype->chunks[location.chunk]->entities[location.row] != (unsigned int)e)
+			return EntityLocation(); // stale handle
+		return location;
+	}
+
+	template <typename Component>
+	Component* component_pointer(const EntityLocation& location)
+	{
+		Archetype& archetype = *location.archetype;
+		const ArchetypeColumn& column = archetype.columns[archetype.column_of[archetype_component_id<Component>()]];
+		return reinterpret_cast<Component*>(archetype.column_data(location.chunk, column)) + (column.size == 0 ? 0 : location.row);
+	}
+
+	// Empty components have no storage, every entity refers to the same instance
+	template <typename Component>
+	Component& element(Component* column, unsigned int row, std::true_type /*is_empty*/)
+	{
+		static Component instance;
+		(void)column; (void)row;
+		return instance;
+	}
+	template <typename Component>
+	Component& element(Component* column, unsigned int row, std::false_type /*is_empty*/)
+	{
+		return column[row];
+	}
+
+public:
+	ArchetypeStorage()
+	{
+	}
+
+	// Insert a bundle of components at once, the entity moves directly into its final archetype
+	template <typename... Components>
+	void insert(Entity e, Components... components)
+	{
+		ComponentSignature signature = location_of(e).archetype ? location_of(e).archetype->signature : 0;
+		using expand = int[];
+		(void)expand{ 0, (register_component<Components>(), signature |= archetype_signature_bit<Components>(), 0)... };
+		EntityLocation location = move_entity(e, signature);
+		(void)expand{ 0, (std::memcpy(component_pointer<Components>(location), &components, std::is_empty<Components>::value ? 0 : sizeof(Components)), 0)... };
+		(void)location;
+	}
+
+	template <typename Component>
+	Component& get(Entity e)
+	{
+		assert(has<Component>(e) && "Entity not contained in archetype storage");
+		return element(component_pointer<Component>(location_of(e)), 0, std::is_empty<Component>());
+	}
+
+	template <typename Component>
+	bool has(Entity e)
+	{
+		EntityLocation location = location_of(e);
+		return location.archetype != nullptr && (location.archetype->signature & archetype_signature_bit<Component>()) != 0;
+	}
+
+	template <typename Component>
+	void remove(Entity e)
+	{
+		if (has<Component>(e))
+			move_entity(e, location_of(e).archetype->signature & ~archetype_signature_bit<Component>());
+	}
+
+	// Remove all components of the entity
+	void remove_all_components_of(Entity e)
+	{
+		EntityLocation location = location_of(e);
+		if (location.archetype == nullptr)
+			return;
+		free_row(location);
+		locations[e.index()] = EntityLocation();
+	}
+
+	// Calls fn(entity, components&...) for every entity whose archetype contains all given components
+	// Walks the component arrays of every matching chunk linearly
+	template <typename... Components, typename Function>
+	void each(Function fn)
+	{
+		ComponentSignature mask = 0;
+		using expand = int[];
+		(void)expand{ 0, (mask |= archetype_signature_bit<Components>(), 0)... };
+		for (auto& it : archetypes)
+		{
+			Archetype& archetype = *it.second;
+			if ((archetype.signature & mask) != mask)
+				continue;
+			for (unsigned int chunk = 0; chunk < archetype.chunks.size(); chunk++)
+			{
+				ArchetypeChunk& data = *archetype.chunks[chunk];
+				EntityLocation first = { &archetype, chunk, 0 };
+				std::tuple<Components*...> columns(component_pointer<Components>(first)...);
+				for (unsigned int row = 0; row < data.entities.size(); row++)
+					fn(data.entities[row], element(std::get<Components*>(columns), row, std::is_empty<Components>())...);
+			}
+		}
+	}
+
+	// Remove all entities, archetypes and their layout are kept
+	void clear()
+	{
+		for (auto& it : archetypes)
+			it.second->chunks.clear();
+		locations.clear();
+	}
+
+	// Report the number of stored entities
+	size_t size()
+	{
+		size_t count = 0;
+		for (auto& it : archetypes)
+			for (auto& chunk : it.second->chunks)
+				count += chunk->entities.size();
+		return count;
+	}
+
+	size_t archetype_count()
+	{
+		return archetypes.size();
+	}
+};
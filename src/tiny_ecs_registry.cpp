@@ -1,3 +1,20 @@
 #include "tiny_ecs_registry.hpp"
 
-ECSRegistry registry;
\ No newline at end of file
+ECSRegistry registry;
+
+Mesh* SnapshotFormat<Mesh*>::meshes = nullptr;
+
+void ECSRegistry::save_previous_motions()
+{
+	// Entries of removed entities are never cleared, their index comes back with a new generation
+	for (unsigned int i = 0; i < motions.components.size(); i++)
+	{
+		const Entity e = motions.entities[i];
+		if (e.index() >= previous_motions.size())
+			previous_motions.resize(e.index() + 1);
+		PreviousMotion& previous = previous_motions[e.index()];
+		previous.entity = e;
+		previous.position = motions.components.position[i];
+		previous.angle = motions.components.angle[i];
+	}
+}
@@ -4,67 +4,76 @@
 #include "tiny_ecs.hpp"
 #include "components.hpp"
 
-class ECSRegistry
+// Mesh pointers are only valid within one run, so snapshots store the geometry they point to instead
+template <>
+struct SnapshotFormat<Mesh*>
 {
-	// Callbacks to remove a particular or all entities in the system
-	std::vector<ContainerInterface*> registry_list;
+	typedef GEOMETRY_BUFFER_ID Stored;
 
-public:
-	// Manually created list of all components this game has
-	// TODO: A1 add a LightUp component
-	ComponentContainer<DeathTimer> deathTimers;
-	ComponentContainer<Motion> motions;
-	ComponentContainer<Collision> collisions;
-	ComponentContainer<Player> players;
-	ComponentContainer<Mesh*> meshPtrs;
-	ComponentContainer<RenderRequest> renderRequests;
-	ComponentContainer<ScreenState> screenStates;
-	ComponentContainer<SoftShell> softShells;
-	ComponentContainer<HardShell> hardShells;
-	ComponentContainer<DebugComponent> debugComponents;
-	ComponentContainer<vec3> colors;
+	// The mesh of every geometry, indexed by GEOMETRY_BUFFER_ID, set by the renderer
+	static Mesh* meshes;
 
-	// constructor that adds all containers for looping over them
-	// IMPORTANT: Don't forget to add any newly added containers!
-	ECSRegistry()
+	static Stored save(Mesh* mesh)
 	{
-		// TODO: A1 add a LightUp component
-		registry_list.push_back(&deathTimers);
-		registry_list.push_back(&motions);
-		registry_list.push_back(&collisions);
-		registry_list.push_back(&players);
-		registry_list.push_back(&meshPtrs);
-		registry_list.push_back(&renderRequests);
-		registry_list.push_back(&screenStates);
-		registry_list.push_back(&softShells);
-		registry_list.push_back(&hardShells);
-		registry_list.push_back(&debugComponents);
-		registry_list.push_back(&colors);
+		return mesh == nullptr ? GEOMETRY_BUFFER_ID::GEOMETRY_COUNT : (GEOMETRY_BUFFER_ID)(mesh - meshes);
 	}
 
-	void clear_all_components() {
-		for (ContainerInterface* reg : registry_list)
-			reg->clear();
+	static Mesh* load(Stored geometry)
+	{
+		return geometry == GEOMETRY_BUFFER_ID::GEOMETRY_COUNT ? nullptr : meshes + (int)geometry;
 	}
+};
 
-	void list_all_components() {
-		printf("Debug info on all registry entries:\n");
-		for (ContainerInterface* reg : registry_list)
-			if (reg->size() > 0)
-				printf("%4d components of type %s\n", (int)reg->size(), typeid(*reg).name());
-	}
+// Manually created list of all components this game has, the registry creates one container per type
+// TODO: A1 add a LightUp component
+typedef Registry<
+	DeathTimer,
+	Motion,
+	Player,
+	Mesh*,
+	RenderRequest,
+	ScreenState,
+	SoftShell,
+	HardShell,
+	DebugComponent,
+	vec3> ComponentRegistry;
 
-	void list_all_components_of(Entity e) {
-		printf("Debug info on components of entity %u:\n", (unsigned int)e);
-		for (ContainerInterface* reg : registry_list)
-			if (reg->has(e))
-				printf("type %s\n", typeid(*reg).name());
-	}
+class ECSRegistry : public ComponentRegistry
+{
+public:
+	// Named access to the containers
+	// IMPORTANT: Don't forget to add any newly added components to the list above!
+	ComponentContainer<DeathTimer>& deathTimers = container<DeathTimer>();
+	ComponentContainer<Motion>& motions = container<Motion>();
+	TagContainer<Player>& players = container<Player>();
+	ComponentContainer<Mesh*>& meshPtrs = container<Mesh*>();
+	ComponentContainer<RenderRequest>& renderRequests = container<RenderRequest>();
+	ComponentContainer<ScreenState>& screenStates = container<ScreenState>();
+	TagContainer<SoftShell>& softShells = container<SoftShell>();
+	TagContainer<HardShell>& hardShells = container<HardShell>();
+	TagContainer<DebugComponent>& debugComponents = container<DebugComponent>();
+	ComponentContainer<vec3>& colors = container<vec3>();
+
+	// Everything that is drawn, its Motion and RenderRequest components share the same dense index
+	OwningGroup<Motion, RenderRequest> drawables{ motions, renderRequests };
+
+	// Remember the Motion of every entity before a simulation step, see PreviousMotion
+	// Writes one array entry per Motion, no lookups and no change tracking.
+	void save_previous_motions();
 
-	void remove_all_components_of(Entity e) {
-		for (ContainerInterface* reg : registry_list)
-			reg->remove(e);
+	// The Motion of 'e' at the start of the last step, nullptr if it had none, e.g., it was created during the step
+	const PreviousMotion* previous_motion(Entity e) const
+	{
+		const unsigned int index = e.index();
+		return index < previous_motions.size() && previous_motions[index].entity == (unsigned int)e ? &previous_motions[index] : nullptr;
 	}
+
+	// Remove all entities of the game world, singletons such as the ScreenState survive
+	void reset_world() { remove_all_entities_except<ScreenState>(); }
+
+private:
+	// Indexed by entity index, an entry is only valid if it was saved for the same entity and generation
+	std::vector<PreviousMotion> previous_motions;
 };
 
-extern ECSRegistry registry;
\ No newline at end of file
+extern ECSRegistry registry;
@@ -2,93 +2,80 @@
 #include "tiny_ecs_registry.hpp"
 #include <world_system.hpp>
 
-Entity createSalmon(RenderSystem* renderer, vec2 pos)
+SoftShellPrefab salmonPrefab(RenderSystem* renderer)
 {
-	auto entity = Entity();
-	std::default_random_engine rng;
-	std::uniform_real_distribution<float> uniform_dist;
-	float screen_width = 1200;
-	float screen_height = 800;
-
 	// Store a reference to the potentially re-used mesh object
 	Mesh& mesh = renderer->getMesh(GEOMETRY_BUFFER_ID::SALMON);
-	registry.meshPtrs.emplace(entity, &mesh);
 
 	// Setting initial motion values
-	Motion& motion = registry.motions.emplace(entity);
-	
-	motion.position = pos;
+	Motion motion;
 	motion.angle = 0.f;
 	motion.velocity = { 0.f, 0.f };
 	motion.scale = mesh.original_size * 150.f;
 	motion.scale.x *= -1; // point front to the right
 
-	// Create and (empty) Salmon component to be able to refer to all turtles
-	//registry.players.emplace(entity);
-	registry.softShells.emplace(entity);
-	registry.renderRequests.insert(
-		entity,
+	return SoftShellPrefab(&mesh, motion, SoftShell(),
 		{ TEXTURE_ASSET_ID::TEXTURE_COUNT, // TEXTURE_COUNT indicates that no txture is needed
 			EFFECT_ASSET_ID::SALMON,
 			GEOMETRY_BUFFER_ID::SALMON });
-
-	return entity;
 }
 
-Entity createFish(RenderSystem* renderer, vec2 position)
+SoftShellPrefab fishPrefab(RenderSystem* renderer)
 {
-	// Reserve en entity
-	auto entity = Entity();
-
 	// Store a reference to the potentially re-used mesh object
 	Mesh& mesh = renderer->getMesh(GEOMETRY_BUFFER_ID::SPRITE);
-	registry.meshPtrs.emplace(entity, &mesh);
 
-	// Initialize the position, scale, and physics components
-	auto& motion = registry.motions.emplace(entity);
+	// Initialize the physics components
+	Motion motion;
 	motion.angle = 0.f;
 	motion.velocity = { -50, 0 };
-	motion.position = position;
 
 	// Setting initial values, scale is negative to make it face the opposite way
 	motion.scale = vec2({ -FISH_BB_WIDTH, FISH_BB_HEIGHT });
 
-	// Create an (empty) Fish component to be able to refer to all fish
-	registry.softShells.emplace(entity);
-	registry.renderRequests.insert(
-		entity,
+	return SoftShellPrefab(&mesh, motion, SoftShell(),
 		{ TEXTURE_ASSET_ID::FISH,
 			EFFECT_ASSET_ID::TEXTURED,
 			GEOMETRY_BUFFER_ID::SPRITE });
-
-	return entity;
 }
 
-Entity createTurtle(RenderSystem* renderer, vec2 position)
+HardShellPrefab turtlePrefab(RenderSystem* renderer)
 {
-	auto entity = Entity();
-
 	// Store a reference to the potentially re-used mesh object (the value is stored in the resource cache)
 	Mesh& mesh = renderer->getMesh(GEOMETRY_BUFFER_ID::SPRITE);
-	registry.meshPtrs.emplace(entity, &mesh);
 
 	// Initialize the motion
-	auto& motion = registry.motions.emplace(entity);
+	Motion motion;
 	motion.angle = 0.f;
 	motion.velocity = { -100.f, 0.f };
-	motion.position = position;
 
 	// Setting initial values, scale is negative to make it face the opposite way
 	motion.scale = vec2({ -TURTLE_BB_WIDTH, TURTLE_BB_HEIGHT });
 
-	// Create and (empty) Turtle component to be able to refer to all turtles
-	registry.hardShells.emplace(entity);
-	registry.renderRequests.insert(
-		entity,
+	return HardShellPrefab(&mesh, motion, HardShell(),
 		{ TEXTURE_ASSET_ID::TURTLE,
 		 EFFECT_ASSET_ID::TEXTURED,
 		 GEOMETRY_BUFFER_ID::SPRITE });
+}
 
+Entity createSalmon(const SoftShellPrefab& prefab, vec2 pos)
+{
+	auto entity = registry.spawn(prefab);
+	registry.motions.patch(entity, [&](MotionRef motion) { motion.position = pos; });
+	return entity;
+}
+
+Entity createFish(const SoftShellPrefab& prefab, vec2 position)
+{
+	auto entity = registry.spawn(prefab);
+	registry.motions.patch(entity, [&](MotionRef motion) { motion.position = position; });
+	return entity;
+}
+
+Entity createTurtle(const HardShellPrefab& prefab, vec2 position)
+{
+	auto entity = registry.spawn(prefab);
+	registry.motions.patch(entity, [&](MotionRef motion) { motion.position = position; });
 	return entity;
 }
 
@@ -104,7 +91,7 @@ Entity createLine(vec2 position, vec2 scale)
 		 GEOMETRY_BUFFER_ID::DEBUG_LINE });
 
 	// Create motion
-	Motion& motion = registry.motions.emplace(entity);
+	MotionRef motion = registry.motions.emplace(entity);
 	motion.angle = 0.f;
 	motion.velocity = { 0, 0 };
 	motion.position = position;
@@ -119,7 +106,7 @@ Entity createPebble(vec2 pos, vec2 size)
 	auto entity = Entity();
 
 	// Setting initial motion values
-	Motion& motion = registry.motions.emplace(entity);
+	MotionRef motion = registry.motions.emplace(entity);
 	motion.position = pos;
 	motion.angle = 0.f;
 	motion.velocity = { 0.f, 0.f };
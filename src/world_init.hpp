@@ -10,12 +10,20 @@ const float FISH_BB_HEIGHT = 0.4f * 165.f;
 const float TURTLE_BB_WIDTH = 0.4f * 300.f;
 const float TURTLE_BB_HEIGHT = 0.4f * 202.f;
 
+// The component values every salmon, fish, or turtle starts with, for Registry::spawn() and Registry::spawn_batch()
+// Build them once after the meshes are loaded, e.g., in WorldSystem::init(), and spawn from the same prefab every time
+typedef Prefab<Mesh*, Motion, SoftShell, RenderRequest> SoftShellPrefab;
+typedef Prefab<Mesh*, Motion, HardShell, RenderRequest> HardShellPrefab;
+SoftShellPrefab salmonPrefab(RenderSystem* renderer);
+SoftShellPrefab fishPrefab(RenderSystem* renderer);
+HardShellPrefab turtlePrefab(RenderSystem* renderer);
+
 // the player
-Entity createSalmon(RenderSystem* renderer, vec2 pos);
+Entity createSalmon(const SoftShellPrefab& prefab, vec2 pos);
 // the prey
-Entity createFish(RenderSystem* renderer, vec2 position);
+Entity createFish(const SoftShellPrefab& prefab, vec2 position);
 // the enemy
-Entity createTurtle(RenderSystem* renderer, vec2 position);
+Entity createTurtle(const HardShellPrefab& prefab, vec2 position);
 // a red line for debugging purposes
 Entity createLine(vec2 position, vec2 size);
 // a pebble
@@ -7,6 +7,7 @@
 #include <sstream>
 
 #include "physics_system.hpp"
+#include "command_buffer.hpp"
 
 // Game configuration
 const size_t MAX_TURTLES = 15;
@@ -122,6 +123,14 @@ void WorldSystem::init(RenderSystem* renderer_arg) {
 	Mix_PlayMusic(background_music, -1);
 	fprintf(stderr, "Loaded music\n");
 
+	// Reserve room for as many entities as the spawn limits allow, and a debug line for each of them,
+	// so that the containers are allocated once and spawning does not move components around
+	registry.reserve(2 * (MAX_SALMON + MAX_TURTLES + MAX_FISH + 2));
+
+	salmon_prefab = salmonPrefab(renderer);
+	fish_prefab = fishPrefab(renderer);
+	turtle_prefab = turtlePrefab(renderer);
+
 	// Set all states to default
     restart_game();
 }
@@ -138,31 +147,31 @@ bool WorldSystem::step(float elapsed_ms_since_last_update) {
 	glfwSetWindowTitle(window, title_ss.str().c_str());
 
 	// Remove debug info from the last step
-	while (registry.debugComponents.entities.size() > 0)
-	    registry.remove_all_components_of(registry.debugComponents.entities.back());
+	registry.debugComponents.each([](Entity entity) { registry.remove_all_components_of(entity); });
 
 	// Removing out of screen entities
 	auto& motions_registry = registry.motions;
 
 	// Remove entities that leave the screen on the left side
-	// Iterate backwards to be able to remove without unterfering with the next object to visit
-	// (the containers exchange the last element with the current)
-	for (int i = (int)motions_registry.components.size()-1; i>=0; --i) {
-	    Motion& motion = motions_registry.components[i];
-		if (motion.position.x + abs(motion.scale.x) < 0.f) {
-		    registry.remove_all_components_of(motions_registry.entities[i]);
+	// The removal is deferred to the sync point, so the container is not modified while we iterate it
+	for (uint i = 0; i < motions_registry.components.size(); i++) {
+		if (motions_registry.components.position[i].x + abs(motions_registry.components.scale[i].x) < 0.f) {
+		    commands.destroy(motions_registry.entities[i]);
 		}
 	}
 
-	// spawning new salmon
+	// spawning new salmon, all that are due in this step (several at a high game speed) are created as one batch
 	next_salmon_spawn -= elapsed_ms_since_last_update * current_speed * 3;
-	if (registry.softShells.components.size() <= MAX_SALMON && next_salmon_spawn < 0.f) {
+	size_t salmon_due = 0;
+	while (registry.softShells.size() + salmon_due <= MAX_SALMON && next_salmon_spawn < 0.f) {
 		// reset timer
-		next_salmon_spawn = (SALMON_DELAY_MS / 2) + uniform_dist(rng) * (SALMON_DELAY_MS / 2);
-		// create salmon
-		Entity entity = createSalmon(renderer, { 0,0 });
+		next_salmon_spawn += (SALMON_DELAY_MS / 2) + uniform_dist(rng) * (SALMON_DELAY_MS / 2);
+		salmon_due++;
+	}
+	// Without room, the next salmon spawns once there is room again and not all that were due in the meantime
+	next_salmon_spawn = max(next_salmon_spawn, 0.f);
+	registry.spawn_batch(salmon_prefab, salmon_due, [&](size_t, Entity, Mesh*&, MotionRef motion, SoftShell&, RenderRequest&) {
 		// setting random initial position and constant velocity
-		Motion& motion = registry.motions.get(entity);
 		motion.position =
 			vec2(screen_width + 200.f, // spawn off-screen
 				50.f + uniform_dist(rng) * (screen_height - 100.f));
@@ -173,17 +182,17 @@ bool WorldSystem::step(float elapsed_ms_since_last_update) {
 		else {
 			motion.velocity = vec2(-200.f, 200);
 		}
-	}
+	});
 
 	// Spawning new turtles
 	next_turtle_spawn -= elapsed_ms_since_last_update * current_speed;
-	if (registry.hardShells.components.size() <= MAX_TURTLES && next_turtle_spawn < 0.f) {
+	if (registry.hardShells.size() <= MAX_TURTLES && next_turtle_spawn < 0.f) {
 		/*// Reset timer
 		next_turtle_spawn = (TURTLE_DELAY_MS / 2) + uniform_dist(rng) * (TURTLE_DELAY_MS / 2);
 		// Create turtle
-		Entity entity = createTurtle(renderer, {0,0});
+		Entity entity = createTurtle(turtle_prefab, {0,0});
 		// Setting random initial position and constant velocity
-		Motion& motion = registry.motions.get(entity);
+		MotionRef motion = registry.motions.get(entity);
 		motion.position =
 			vec2(screen_width -200.f, 
 				 50.f + uniform_dist(rng) * (screen_height - 100.f));
@@ -192,7 +201,7 @@ bool WorldSystem::step(float elapsed_ms_since_last_update) {
 
 	// Spawning new fish
 	next_fish_spawn -= elapsed_ms_since_last_update * current_speed;
-	if (registry.softShells.components.size() <= MAX_FISH && next_fish_spawn < 0.f) {
+	if (registry.softShells.size() <= MAX_FISH && next_fish_spawn < 0.f) {
 		// !!!  TODO A1: Create new fish with createFish({0,0}), as for the Turtles above
 	}
 
@@ -202,14 +211,17 @@ bool WorldSystem::step(float elapsed_ms_since_last_update) {
 	// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 
 	// Processing the salmon state
-	assert(registry.screenStates.components.size() <= 1);
-    ScreenState &screen = registry.screenStates.components[0];
+	assert(registry.screenStates.size() == 1);
+    ScreenState &screen = registry.screenStates.get(registry.screenStates.entities[0]);
+
+	// progress all timers in parallel, the loop below marks them as changed with get() and handles the expired ones
+	registry.deathTimers.parallel_for_each([&](Entity, DeathTimer& counter) {
+		counter.counter_ms -= elapsed_ms_since_last_update;
+	});
 
     float min_counter_ms = 3000.f;
 	for (Entity entity : registry.deathTimers.entities) {
-		// progress timer
 		DeathTimer& counter = registry.deathTimers.get(entity);
-		counter.counter_ms -= elapsed_ms_since_last_update;
 		if(counter.counter_ms < min_counter_ms){
 		    min_counter_ms = counter.counter_ms;
 		}
@@ -239,16 +251,23 @@ void WorldSystem::restart_game() {
 	// Reset the game speed
 	current_speed = 1.f;
 
-	// Remove all entities that we created
-	// All that have a motion, we could also iterate over all fish, turtles, ... but that would be more cumbersome
-	while (registry.motions.entities.size() > 0)
-	    registry.remove_all_components_of(registry.motions.entities.back());
+	// Restore the initial world, its entities get new handles and every handle of the old world is stale afterwards
+	// The commands recorded for the old world are dropped, they could only refer to stale handles
+	if (!initial_world.empty()) {
+		commands.clear();
+		registry.restore(initial_world);
+		player_salmon = Entity::restored(initial_player_salmon);
+		return;
+	}
+
+	// Remove all entities that we created, only the screen state of the renderer survives
+	registry.reset_world();
 
 	// Debugging for memory/component leaks
 	registry.list_all_components();
 
 	// Create a new salmon
-	player_salmon = createSalmon(renderer, {100, 200});
+	player_salmon = createSalmon(salmon_prefab, {100, 200});
 	registry.players.emplace(player_salmon);
 	registry.softShells.remove(player_salmon);
 	registry.colors.insert(player_salmon, {1, 0.8f, 0.8f}); 
@@ -269,11 +288,15 @@ void WorldSystem::restart_game() {
 		registry.colors.insert(pebble, { brightness, brightness, brightness});
 	}
 	*/
+
+	// Checkpoint for the next restarts
+	registry.save(initial_world);
+	initial_player_salmon = player_salmon;
 }
 
 void handleRockPlayerBounce(Entity entity, Entity entity_other) {
-	Motion& motion1 = registry.motions.get(entity);
-	Motion& motion2 = registry.motions.get(entity_other);
+	MotionRef motion1 = registry.motions.get(entity);
+	MotionRef motion2 = registry.motions.get(entity_other);
 
 	vec2 vel1temp = motion1.velocity;
 	motion1.velocity = motion2.velocity;
@@ -281,8 +304,8 @@ void handleRockPlayerBounce(Entity entity, Entity entity_other) {
 }
 
 void handleRockBounce(Entity entity, Entity entity_other) {
-	Motion& motion1 = registry.motions.get(entity);
-	Motion& motion2 = registry.motions.get(entity_other);
+	MotionRef motion1 = registry.motions.get(entity);
+	MotionRef motion2 = registry.motions.get(entity_other);
 	float dist = sqrt(pow(motion1.position.x - motion2.position.x, 2) + pow(motion1.position.y - motion2.position.y, 2));
 	// source: https://www.youtube.com/watch?v=LPzyNOHY3A4
 	float overlap = 0.5f * (dist - 25 - 25); // Overlap between circles is the distance between centers minus both radii (half for resolution)
@@ -329,43 +352,44 @@ void handleRockBounce(Entity entity, Entity entity_other) {
 }
 
 // Compute collisions between entities
-void WorldSystem::handle_collisions() {
-	// Loop over all collisions detected by the physics system
-	auto& collisionsRegistry = registry.collisions; // TODO: @Tim, is the reference here needed?
-	for (uint i = 0; i < collisionsRegistry.components.size(); i++) {
-		// The entity and its collider
-		Entity entity = collisionsRegistry.entities[i];
-		Entity entity_other = collisionsRegistry.components[i].other;
+void WorldSystem::handle_collisions(const ContactBuffer& contacts) {
+	// Loop over all collisions detected by the physics system, every pair is reported once in either order
+	for (uint i = 0; i < contacts.size(); i++) {
+		// The two entities of the contact
+		Entity entity_a = contacts.entity_a[i];
+		Entity entity_b = contacts.entity_b[i];
 
 		// check salmon - salmon collisions
-		if (registry.softShells.has(entity) && registry.softShells.has(entity_other)) {
-			handleRockBounce(entity, entity_other);
+		if (registry.softShells.has(entity_a) && registry.softShells.has(entity_b)) {
+			handleRockBounce(entity_a, entity_b);
 		}
 
 		// For now, we are only interested in collisions that involve the salmon
-		if (registry.players.has(entity)) {
-			//Player& player = registry.players.get(entity);
-
-			// Checking Player - HardShell collisions
-			if (registry.softShells.has(entity_other)) {
-				// initiate death unless already dying
-				if (!registry.deathTimers.has(entity)) {
-					// Scream, reset timer, and make the salmon sink
-					handleRockPlayerBounce(entity, entity_other);
-					registry.deathTimers.emplace(entity);
-					Mix_PlayChannel(-1, salmon_dead_sound, 0);
-					//registry.motions.get(entity).angle = 3.1415f;
-					//registry.motions.get(entity).velocity = { 0, 80 };
-					registry.colors.get(entity).r = 255;
-					registry.colors.get(entity).g = 0;
-					registry.colors.get(entity).b = 0;
-				}
-			}
+		if (registry.players.has(entity_a) && registry.softShells.has(entity_b)) {
+			handle_player_hit(entity_a, entity_b);
+		}
+		else if (registry.players.has(entity_b) && registry.softShells.has(entity_a)) {
+			handle_player_hit(entity_b, entity_a);
 		}
 	}
+}
 
-	// Remove all collisions from this simulation step
-	registry.collisions.clear();
+// Checking Player - HardShell collisions
+void WorldSystem::handle_player_hit(Entity entity, Entity entity_other) {
+	//Player& player = registry.players.get(entity);
+
+	// initiate death unless already dying
+	if (!registry.deathTimers.has(entity)) {
+		// Scream, reset timer, and make the salmon sink
+		handleRockPlayerBounce(entity, entity_other);
+		registry.deathTimers.emplace(entity);
+		Mix_PlayChannel(-1, salmon_dead_sound, 0);
+		//registry.motions.get(entity).angle = 3.1415f;
+		//registry.motions.get(entity).velocity = { 0, 80 };
+		registry.colors.get(entity).r = 255;
+		registry.colors.get(entity).g = 0;
+		registry.colors.get(entity).b = 0;
+	}
 }
 
 // Should the game be over ?
@@ -389,6 +413,11 @@ void WorldSystem::on_key(int key, int, int action, int mod) {
         restart_game();
 	}
 
+	// Dump the memory use and access counts of the ECS containers
+	if (action == GLFW_RELEASE && key == GLFW_KEY_I) {
+		registry.write_stats_json(stdout);
+	}
+
 	// Debugging
 	if (key == GLFW_KEY_D) {
 		if (action == GLFW_RELEASE)
@@ -412,7 +441,7 @@ void WorldSystem::on_key(int key, int, int action, int mod) {
 	if (registry.deathTimers.entities.empty()) {
 		// Left
 		if (key == GLFW_KEY_LEFT) {
-			Motion& salmonMotion = registry.motions.get(player_salmon);
+			MotionRef salmonMotion = registry.motions.get(player_salmon);
 			if (action == GLFW_RELEASE) {
 				salmonMotion.velocity.x = 0;
 			}
@@ -422,7 +451,7 @@ void WorldSystem::on_key(int key, int, int action, int mod) {
 		}
 		// Right
 		if (key == GLFW_KEY_RIGHT) {
-			Motion& salmonMotion = registry.motions.get(player_salmon);
+			MotionRef salmonMotion = registry.motions.get(player_salmon);
 			if (action == GLFW_RELEASE) {
 				salmonMotion.velocity.x = 0;
 			}
@@ -432,7 +461,7 @@ void WorldSystem::on_key(int key, int, int action, int mod) {
 		}
 		// Up
 		if (key == GLFW_KEY_UP) {
-			Motion& salmonMotion = registry.motions.get(player_salmon);
+			MotionRef salmonMotion = registry.motions.get(player_salmon);
 			if (action == GLFW_RELEASE) {
 				salmonMotion.velocity.y = 0;
 			}
@@ -442,7 +471,7 @@ void WorldSystem::on_key(int key, int, int action, int mod) {
 		}
 		// Down
 		if (key == GLFW_KEY_DOWN) {
-			Motion& salmonMotion = registry.motions.get(player_salmon);
+			MotionRef salmonMotion = registry.motions.get(player_salmon);
 			if (action == GLFW_RELEASE) {
 				salmonMotion.velocity.y = 0;
 			}
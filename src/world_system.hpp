@@ -12,6 +12,8 @@
 #include <SDL_mixer.h>
 
 #include "render_system.hpp"
+#include "contact_buffer.hpp"
+#include "world_init.hpp"
 
 // Container for all our entities and game logic. Individual rendering / update is
 // deferred to the relative update() methods
@@ -33,7 +35,7 @@ public:
 	bool step(float elapsed_ms);
 
 	// Check for collisions
-	void handle_collisions();
+	void handle_collisions(const ContactBuffer& contacts);
 
 	// Should the game be over ?
 	bool is_over()const;
@@ -45,6 +47,9 @@ private:
 	// restart level
 	void restart_game();
 
+	// The salmon ran into a rock
+	void handle_player_hit(Entity entity, Entity entity_other);
+
 	// OpenGL window handle
 	GLFWwindow* window;
 
@@ -59,6 +64,16 @@ private:
 	float next_salmon_spawn;
 	Entity player_salmon;
 
+	// Built once in init(), every spawn copies them
+	SoftShellPrefab salmon_prefab;
+	SoftShellPrefab fish_prefab;
+	HardShellPrefab turtle_prefab;
+
+	// The world right after the first start, later restarts restore it instead of creating it again
+	Snapshot initial_world;
+	// The handle of the player in the initial world, a restore re-issues it, see Entity::restored()
+	Entity initial_player_salmon = Entity::from_index(0);
+
 	// music references
 	Mix_Music* background_music;
 	Mix_Chunk* salmon_dead_sound;
@@ -0,0 +1,362 @@
+// Tests of the ECS containers and registry and of the collision detection, run with ctest
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include "tiny_ecs.hpp"
+#include "components.hpp"
+#include "broadphase.hpp"
+#include "narrowphase.hpp"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			failures++; \
+		} \
+	} while (0)
+
+struct Position { float x, y; };
+struct Sprite { int texture; };
+struct Marker {};
+
+typedef Registry<Position, Sprite, Marker> TestRegistry;
+
+// A restore re-issues the handles of the snapshot, no handle from before the restore may alias a restored entity
+static void test_restore_invalidates_handles()
+{
+	TestRegistry registry;
+	Entity kept;
+	registry.container<Position>().insert(kept, { 1, 2 });
+	registry.container<Marker>().emplace(kept);
+	Entity released;
+	registry.container<Position>().insert(released, { 3, 4 });
+	Snapshot snapshot;
+	registry.save(snapshot);
+
+	// Released after the save and recycled by a new entity
+	registry.remove_all_components_of(released);
+	Entity created;
+	registry.container<Position>().insert(created, { 5, 6 });
+
+	registry.restore(snapshot);
+	CHECK(!Entity::is_alive(kept));
+	CHECK(!Entity::is_alive(released));
+	CHECK(!Entity::is_alive(created));
+	CHECK(!registry.container<Position>().has(kept));
+	CHECK(!registry.container<Position>().has(released));
+	CHECK(!registry.container<Position>().has(created));
+	CHECK(!registry.container<Marker>().has(kept));
+
+	// The entities of the snapshot are alive under their new handles
+	Entity restored = Entity::restored(kept);
+	CHECK(Entity::is_alive(restored));
+	CHECK(registry.container<Position>().has(restored) && registry.container<Position>().read(restored).y == 2);
+	CHECK(registry.container<Marker>().has(restored));
+	CHECK(registry.container<Position>().has(Entity::restored(released)));
+	CHECK(registry.container<Position>().size() == 2);
+
+	// A second restore invalidates the handles of the first one
+	registry.restore(snapshot);
+	CHECK(!Entity::is_alive(restored));
+	CHECK(registry.container<Position>().has(Entity::restored(kept)));
+
+	// Removing a stale handle does not touch the restored entity
+	registry.remove_all_components_of(kept);
+	CHECK(registry.container<Position>().size() == 2);
+	registry.clear_all_components();
+}
+
+// A factory keeps the reference returned by one insert while it inserts the other components of the entity,
+// completing the group of a second entity must not move the component behind the reference
+static void test_group_insert_keeps_references()
+{
+	TestRegistry registry;
+	registry.reserve(16); // inserts within the reserved capacity do not reallocate
+	ComponentContainer<Position>& positions = registry.container<Position>();
+	ComponentContainer<Sprite>& sprites = registry.container<Sprite>();
+	OwningGroup<Position, Sprite> group(positions, sprites);
+
+	Entity member;
+	positions.insert(member, { 0, 0 });
+	sprites.insert(member, { 0 });
+	CHECK(group.size() == 1);
+
+	Entity first, second;
+	Position& first_position = positions.insert(first, { 1, 1 });
+	Position& second_position = positions.insert(second, { 2, 2 });
+	sprites.insert(second, { 2 }); // completes the group of 'second'
+	sprites.insert(first, { 1 });
+	first_position.x = 10;
+	second_position.x = 20;
+	CHECK(positions.read(first).x == 10);
+	CHECK(positions.read(second).x == 20);
+
+	// Both joined at the next access of the group, with the components of each slot side by side
+	CHECK(group.size() == 3);
+	CHECK(group.contains(first) && group.contains(second));
+	int visited = 0;
+	group.each([&](Entity e, Position& position, Sprite& sprite)
+	{
+		CHECK(position.x == (e == first ? 10 : e == second ? 20 : 0));
+		CHECK(sprite.texture == (e == first ? 1 : e == second ? 2 : 0));
+		visited++;
+	});
+	CHECK(visited == 3);
+
+	// A pending entity that lost a component before the next access does not join
+	Entity partial;
+	positions.insert(partial, { 3, 3 });
+	sprites.insert(partial, { 3 });
+	sprites.remove(partial);
+	CHECK(group.size() == 3 && !group.contains(partial));
+	registry.clear_all_components();
+}
+
+// An on_update listener runs after the write and reads the new value, get() alone does not notify
+static void test_update_listeners_see_writes()
+{
+	TestRegistry registry;
+	ComponentContainer<Position>& positions = registry.container<Position>();
+	Entity e;
+	positions.insert(e, { 411, 0 });
+	int updates = 0;
+	float seen = 0;
+	positions.on_update().connect([&](Entity updated)
+	{
+		updates++;
+		seen = positions.read(updated).x;
+	});
+
+	positions.get(e).x = 1;
+	CHECK(updates == 0);
+	positions.patch(e, [](Position& position) { position.x = 12345; });
+	CHECK(updates == 1 && seen == 12345);
+	positions.components[0].x = 7;
+	positions.touch(e);
+	CHECK(updates == 2 && seen == 7);
+	registry.clear_all_components();
+}
+
+// spawn_batch() hands init() the new slots and notifies on_construct afterwards, with the initialized values
+static void test_spawn_batch_notifies_after_init()
+{
+	TestRegistry registry;
+	registry.reserve(16);
+	ComponentContainer<Position>& positions = registry.container<Position>();
+	OwningGroup<Position, Sprite> group(positions, registry.container<Sprite>());
+	int constructed = 0;
+	bool initialized = true;
+	positions.on_construct().connect([&](Entity e)
+	{
+		constructed++;
+		initialized = initialized && positions.read(e).x == e.index();
+	});
+
+	Prefab<Position, Sprite, Marker> prefab(Position{ 0, 0 }, Sprite{ 3 }, Marker());
+	const std::vector<Entity>& spawned = registry.spawn_batch(prefab, 4, [&](size_t, Entity e, Position& position, Sprite&, Marker&)
+	{
+		CHECK(constructed == 0);
+		position.x = (float)e.index();
+	});
+	CHECK(spawned.size() == 4 && constructed == 4 && initialized);
+	CHECK(group.size() == 4);
+	for (Entity e : spawned)
+		CHECK(registry.container<Marker>().has(e) && registry.container<Sprite>().read(e).texture == 3);
+	registry.clear_all_components();
+}
+
+// Motion is stored as one array per field, the proxy reads and writes in place and every operation that moves
+// slots (remove, group joins, sort, restore) moves all fields of a slot together
+static void test_motion_fields_stay_together()
+{
+	typedef Registry<Motion, Sprite> MotionRegistry;
+	MotionRegistry registry;
+	ComponentContainer<Motion>& motions = registry.container<Motion>();
+	ComponentContainer<Sprite>& sprites = registry.container<Sprite>();
+
+	// Every field of entity e holds e.index() in some form
+	auto expected = [](Entity e)
+	{
+		Motion motion;
+		const float f = (float)e.index();
+		motion.position = { f, -f };
+		motion.angle = 2 * f;
+		motion.velocity = { 3 * f, 0 };
+		motion.scale = { 4 * f, 5 * f };
+		return motion;
+	};
+	auto matches = [&](Entity e)
+	{
+		const Motion motion = motions.read(e);
+		const Motion want = expected(e);
+		return motion.position == want.position && motion.angle == want.angle && motion.velocity == want.velocity && motion.scale == want.scale;
+	};
+
+	std::vector<Entity> entities(6);
+	for (Entity e : entities)
+	{
+		MotionRef motion = motions.emplace(e);
+		motion = expected(e);
+		motion.angle = 0;
+		motions.get(e).angle = expected(e).angle;
+	}
+	{
+		OwningGroup<Motion, Sprite> group(motions, sprites);
+		for (size_t i = 1; i < entities.size(); i += 2)
+			sprites.insert(entities[i], { 0 }); // joins the group, swapping the Motion slots
+		CHECK(group.size() == 3);
+		motions.remove(entities[2]);
+		for (size_t i = 0; i < entities.size(); i++)
+			CHECK(i == 2 ? !motions.has(entities[i]) : matches(entities[i]));
+		group.each([&](Entity e, MotionRef motion, Sprite&) { CHECK(motion.angle == expected(e).angle); });
+	}
+
+	motions.sort([](Entity a, Entity b) { return a.index() > b.index(); });
+	for (size_t i = 1; i < motions.size(); i++)
+		CHECK(motions.entities[i - 1].index() > motions.entities[i].index());
+
+	Snapshot snapshot;
+	registry.save(snapshot);
+	registry.restore(snapshot);
+	CHECK(motions.size() == 5);
+	for (size_t i = 0; i < motions.size(); i++)
+	{
+		// The restored handles keep the index, so the fields still match their entity
+		CHECK(motions.components.position[i].x == (float)motions.entities[i].index());
+		CHECK(matches(motions.entities[i]));
+	}
+	registry.clear_all_components();
+}
+
+// Every broadphase reports exactly the overlapping pairs of an O(n^2) search, while bodies come and go,
+// indices are re-used with a new generation, and a few bodies are far larger than a grid cell
+static void test_broadphases_match_brute_force()
+{
+	for (int id = 0; id < broadphase_count; id++)
+	{
+		std::mt19937 random(7);
+		std::uniform_real_distribution<float> position(-500.f, 2500.f), small_radius(1.f, 90.f), large_radius(200.f, 3000.f), jitter(-20.f, 20.f);
+		Broadphase broadphase;
+		broadphase.select((BROADPHASE_ID)id);
+		std::vector<unsigned int> keys, freed;
+		std::vector<float> x, y, radius;
+		unsigned int next_index = 1;
+		std::vector<CandidatePair> expected, found;
+		bool matched = true;
+		for (int step = 0; step < 200 && matched; step++)
+		{
+			// Remove a few bodies by swapping in the last one, then add some, half of them on a released index
+			for (int k = 0; k < 3 && !keys.empty(); k++)
+			{
+				size_t i = random() % keys.size();
+				freed.push_back(keys[i]);
+				keys[i] = keys.back(); keys.pop_back();
+				x[i] = x.back(); x.pop_back();
+				y[i] = y.back(); y.pop_back();
+				radius[i] = radius.back(); radius.pop_back();
+			}
+			for (int k = 0; k < 4; k++)
+			{
+				if (!freed.empty() && random() % 2 == 0)
+				{
+					keys.push_back(freed.back() + (1u << ENTITY_INDEX_BITS)); // next generation
+					freed.pop_back();
+				}
+				else
+					keys.push_back(next_index++);
+				x.push_back(position(random));
+				y.push_back(position(random));
+				radius.push_back(random() % 50 == 0 ? large_radius(random) : small_radius(random));
+			}
+			for (size_t i = 0; i < keys.size(); i++)
+			{
+				x[i] += jitter(random);
+				y[i] += jitter(random);
+			}
+
+			const unsigned int count = (unsigned int)keys.size();
+			expected.clear();
+			for (unsigned int i = 0; i < count; i++)
+			{
+				for (unsigned int j = i + 1; j < count; j++)
+				{
+					float dx = x[j] - x[i];
+					float dy = y[j] - y[i];
+					float r = radius[i] + radius[j];
+					if (dx * dx + dy * dy < r * r)
+						expected.push_back(std::make_pair(i, j));
+				}
+			}
+			broadphase.find_pairs(keys.data(), x.data(), y.data(), radius.data(), count, found);
+			matched = found == expected;
+		}
+		if (!matched)
+			fprintf(stderr, "%s broadphase:\n", broadphase_name((BROADPHASE_ID)id));
+		CHECK(matched);
+	}
+}
+
+// The SIMD kernels of BatchNarrowphase (SSE2, or AVX2 with SALMON_AVX2) hit exactly where a scalar test does
+// The counts are no multiple of the register width, so the scalar tail runs as well.
+static void test_narrowphase_matches_scalar()
+{
+	std::mt19937 random(11);
+	std::uniform_real_distribution<float> offset(-300.f, 300.f), size(0.f, 150.f);
+	BatchNarrowphase narrowphase;
+	std::vector<unsigned int> distance_hits, box_hits, hits;
+	for (int round = 0; round < 2; round++)
+	{
+		narrowphase.clear();
+		distance_hits.clear();
+		box_hits.clear();
+
+		// Exactly on the limit, a distance test misses and a box test hits
+		unsigned int id = 0;
+		narrowphase.add_distance_test(id++, vec2(3.f, 4.f), 25.f);
+		narrowphase.add_box_test(id, vec2(12.f, 0.f), vec2(10.f, 5.f), 4.f);
+		box_hits.push_back(id++);
+
+		for (int i = 0; i < 1003; i++, id++)
+		{
+			const vec2 d(offset(random), offset(random));
+			const float limit = size(random) * 2.f;
+			narrowphase.add_distance_test(id, d, limit * limit);
+			if (d.x * d.x + d.y * d.y < limit * limit)
+				distance_hits.push_back(id);
+		}
+		for (int i = 0; i < 1001; i++, id++)
+		{
+			const vec2 d(offset(random), offset(random));
+			const vec2 half(size(random), size(random));
+			const float radius = size(random);
+			narrowphase.add_box_test(id, d, half, radius * radius);
+			float x = std::max(std::fabs(d.x) - half.x, 0.f);
+			float y = std::max(std::fabs(d.y) - half.y, 0.f);
+			if (x * x + y * y <= radius * radius)
+				box_hits.push_back(id);
+		}
+
+		// The distance tests are reported first, each kind in queued order
+		narrowphase.run(hits);
+		distance_hits.insert(distance_hits.end(), box_hits.begin(), box_hits.end());
+		CHECK(hits == distance_hits);
+	}
+}
+
+int main()
+{
+	test_restore_invalidates_handles();
+	test_group_insert_keeps_references();
+	test_update_listeners_see_writes();
+	test_spawn_batch_notifies_after_init();
+	test_motion_fields_stay_together();
+	test_broadphases_match_brute_force();
+	test_narrowphase_matches_scalar();
+	if (failures == 0)
+		printf("All ECS tests passed\n");
+	return failures == 0 ? 0 : 1;
+}